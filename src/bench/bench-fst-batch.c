@@ -0,0 +1,219 @@
+/*
+ * Filename: bench-fst-batch.c
+ * Library: libfst
+ * Brief: Microbenchmark -- batch prefix lookup vs. one key at a time
+ *
+ * Copyright (C) 2015-2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Build an FST that is much bigger than the cache, from random
+ * digit strings, then look up a random mix of keys (with trailing
+ * junk, so they are prefix matches) and misses, first with a loop
+ * of fst_lookup_prefix(), then with fst_lookup_prefix_batch().
+ * The loop is also timed without the jump table.
+ *
+ * Usage: bench-fst-batch [ <nkeys> [ <nlookups> [ <seed> ] ] ]
+ *
+ * Output is one "metric<TAB>value<TAB>unit" line per measurement.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+    // Import fprintf()
+    // Import printf()
+    // Import var stderr
+#include <stdlib.h>
+    // Import exit()
+    // Import malloc()
+    // Import strtoul()
+#include <string.h>
+    // Import memcpy()
+    // Import strlen()
+#include <time.h>
+    // Import clock_gettime()
+
+#include <libfst.h>
+
+#define KEY_MIN  8
+#define KEY_MAX 14
+#define QRY_MAX (KEY_MAX + 4)
+
+static unsigned long long rng_state;
+
+static inline unsigned int
+rng(void)
+{
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((unsigned int)((rng_state * 2685821657736338717ULL) >> 32));
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static void
+random_digits(char *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        buf[i] = '0' + rng() % 10;
+    }
+    buf[len] = '\0';
+}
+
+int
+main(int argc, char **argv)
+{
+    fst_t *builder;
+    fst_t *fst;
+    fst_t *fst_nj;
+    char *keyv;
+    char *qryv;
+    const char **qptrv;
+    val_t *vals1;
+    val_t *vals2;
+    int *errs2;
+    size_t nkeys = 200000;
+    size_t nlookups = 1000000;
+    size_t nadded;
+    size_t nfound1;
+    size_t nfound2;
+    size_t i;
+    double t0, t1, t_single, t_nojump, t_batch;
+
+    rng_state = 0x9E3779B97F4A7C15ULL;
+    if (argc > 1) {
+        nkeys = strtoul(argv[1], NULL, 10);
+    }
+    if (argc > 2) {
+        nlookups = strtoul(argv[2], NULL, 10);
+    }
+    if (argc > 3) {
+        rng_state ^= strtoul(argv[3], NULL, 10);
+    }
+
+    keyv = malloc(nkeys * (KEY_MAX + 1));
+    qryv = malloc(nlookups * (QRY_MAX + 1));
+    qptrv = malloc(nlookups * sizeof (char *));
+    vals1 = malloc(nlookups * sizeof (val_t));
+    vals2 = malloc(nlookups * sizeof (val_t));
+    errs2 = malloc(nlookups * sizeof (int));
+    if (!keyv || !qryv || !qptrv || !vals1 || !vals2 || !errs2) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(64);
+    }
+
+    builder = fst_new();
+    nadded = 0;
+    t0 = now();
+    for (i = 0; i < nkeys; ++i) {
+        char *key = keyv + i * (KEY_MAX + 1);
+        random_digits(key, KEY_MIN + rng() % (KEY_MAX - KEY_MIN + 1));
+        if (fst_add_string(builder, key, i) == 0) {
+            ++nadded;
+        }
+    }
+    t1 = now();
+    printf("build_keys\t%zu\tkeys\n", nadded);
+    printf("build_time\t%.6f\ts\n", t1 - t0);
+
+    t0 = now();
+    fst = fst_copy_and_pack(builder);
+    t1 = now();
+    printf("pack_time\t%.6f\ts\n", t1 - t0);
+    printf("packed_size\t%zu\tbytes\n", fst_measure(fst));
+    printf("jump_depth\t%zu\tsteps\n", fst_jump_depth(fst));
+    fst_nj = fst_copy_and_pack_jump(builder, 0);
+
+    // Three out of four lookups are hits, with trailing junk.
+    for (i = 0; i < nlookups; ++i) {
+        char *qry = qryv + i * (QRY_MAX + 1);
+        if (rng() % 4 != 0) {
+            const char *key = keyv + (rng() % nkeys) * (KEY_MAX + 1);
+            size_t len = strlen(key);
+            memcpy(qry, key, len);
+            random_digits(qry + len, rng() % (QRY_MAX - len + 1));
+        }
+        else {
+            random_digits(qry, KEY_MIN + rng() % (QRY_MAX - KEY_MIN + 1));
+        }
+        qptrv[i] = qry;
+    }
+
+    nfound1 = 0;
+    t0 = now();
+    for (i = 0; i < nlookups; ++i) {
+        if (fst_lookup_prefix(fst, qptrv[i], &vals1[i]) == 0) {
+            ++nfound1;
+        }
+        else {
+            vals1[i] = (val_t)-1;
+        }
+    }
+    t1 = now();
+    t_single = t1 - t0;
+
+    t0 = now();
+    for (i = 0; i < nlookups; ++i) {
+        val_t val;
+        if (fst_lookup_prefix(fst_nj, qptrv[i], &val) == 0 && val != vals1[i]) {
+            fprintf(stderr, "Jump table changed result of lookup %zu.\n", i);
+            exit(1);
+        }
+    }
+    t1 = now();
+    t_nojump = t1 - t0;
+
+    t0 = now();
+    nfound2 = fst_lookup_prefix_batch(fst, qptrv, nlookups, vals2, errs2);
+    t1 = now();
+    t_batch = t1 - t0;
+
+    for (i = 0; i < nlookups; ++i) {
+        val_t v2 = errs2[i] ? (val_t)-1 : vals2[i];
+        if (vals1[i] != v2) {
+            fprintf(stderr, "Mismatch at lookup %zu, key '%s'.\n",
+                i, qptrv[i]);
+            exit(1);
+        }
+    }
+    if (nfound1 != nfound2) {
+        fprintf(stderr, "Found counts differ: %zu vs %zu.\n",
+            nfound1, nfound2);
+        exit(1);
+    }
+
+    printf("lookups\t%zu\tkeys\n", nlookups);
+    printf("found\t%zu\tkeys\n", nfound1);
+    printf("prefix_loop_nojump_rate\t%.0f\tlookups/s\n", nlookups / t_nojump);
+    printf("prefix_loop_rate\t%.0f\tlookups/s\n", nlookups / t_single);
+    printf("prefix_batch_rate\t%.0f\tlookups/s\n", nlookups / t_batch);
+    printf("batch_speedup\t%.2f\tx\n", t_single / t_batch);
+
+    exit(0);
+}
@@ -0,0 +1,415 @@
+/*
+ * Filename: bench-isbn.c
+ * Project: isbn-hyphenate
+ * Brief: Microbenchmark -- table build, footprint, and lookup latency
+ *
+ * Copyright (C) 2015-2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Measure, for the real range table:
+ *
+ *   - time to load the XML range table;
+ *   - time to build the prefix FST, and time to pack it;
+ *   - memory footprint of the FST and tables, and peak RSS;
+ *   - throughput, and latency percentiles, of
+ *       fst_lookup_string()    on the prefixes themselves,
+ *       fst_lookup_prefix()    on ISBN-13s,
+ *       fst_lookup_prefix_batch()
+ *       hyphenate_isbn()
+ *       hyphenate_isbn_u64()
+ *       isbn_push_feed()       on newline-separated text, in chunks
+ *
+ * The ISBN-13s come from isbn_corpus_new(), weighted toward the
+ * groups that dominate real traffic (978-0, 978-1, ...).
+ *
+ * Usage: bench-isbn [ -x <range-table.xml> ] [ -n <nlookups> ] [ -s <seed> ]
+ *
+ * Output is one "metric<TAB>value<TAB>unit" line per measurement,
+ * suitable for bench-compare.
+ *
+ * Latencies are measured one call at a time with clock_gettime(),
+ * less the median cost of an empty measurement.  Throughput is
+ * measured separately, over the whole input, without timing each call.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+    // Import var ENOENT
+#include <stdbool.h>
+    // Import type bool
+#include <stdint.h>
+    // Import type uint64_t
+#include <stdio.h>
+    // Import fprintf()
+    // Import printf()
+    // Import snprintf()
+    // Import var stderr
+#include <stdlib.h>
+    // Import exit()
+    // Import malloc()
+    // Import qsort()
+    // Import strtoul()
+    // Import strtoull()
+#include <string.h>
+    // Import strcmp()
+    // Import strlen()
+#include <sys/resource.h>
+    // Import getrusage()
+#include <time.h>
+    // Import clock_gettime()
+#include <unistd.h>
+    // Import getopt()
+
+#include <isbn-corpus.h>
+#include <isbn-info.h>
+#include <isbn-push.h>
+#include <libfst.h>
+
+const char *program_path;
+const char *program_name = "bench-isbn";
+
+FILE *eprint_fh = NULL;
+FILE *dprint_fh = NULL;
+
+bool verbose  = false;
+bool debug    = false;
+
+#define ISBN_SZ 14
+
+// Chunk size for isbn_push_feed(), like a TCP segment,
+// so that most chunks end in the middle of a record.
+#define PUSH_CHUNK 1460
+
+static inline uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static double
+now(void)
+{
+    return (now_ns() / 1e9);
+}
+
+static void
+metric(const char *name, double value, const char *unit)
+{
+    printf("%s\t%.6g\t%s\n", name, value, unit);
+}
+
+// #################### Latency percentiles
+
+static int
+cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return ((x > y) - (x < y));
+}
+
+static uint32_t timer_overhead;
+
+static void
+calibrate_timer(uint32_t *latv, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        uint64_t t0 = now_ns();
+        latv[i] = (uint32_t)(now_ns() - t0);
+    }
+    qsort(latv, n, sizeof (uint32_t), cmp_u32);
+    timer_overhead = latv[n / 2];
+}
+
+static void
+report_latency(const char *name, uint32_t *latv, size_t n)
+{
+    static const struct { const char *sfx; double q; } pctv[] = {
+        { "p50", 0.50 }, { "p90", 0.90 }, { "p99", 0.99 }, { "p999", 0.999 }
+    };
+    char mname[64];
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        latv[i] = latv[i] > timer_overhead ? latv[i] - timer_overhead : 0;
+    }
+    qsort(latv, n, sizeof (uint32_t), cmp_u32);
+    for (i = 0; i < sizeof (pctv) / sizeof (pctv[0]); ++i) {
+        snprintf(mname, sizeof (mname), "%s_%s", name, pctv[i].sfx);
+        metric(mname, latv[(size_t)(pctv[i].q * (n - 1))], "ns");
+    }
+}
+
+static void
+report_rate(const char *name, size_t n, double secs)
+{
+    char mname[64];
+
+    snprintf(mname, sizeof (mname), "%s_rate", name);
+    metric(mname, n / secs, "lookups/s");
+}
+
+static void
+push_count(void *arg, const char *rec, size_t len, int rv,
+    const isbn_lookup_t *res)
+{
+    (void)rec;
+    (void)len;
+    (void)res;
+    if (rv == 0) {
+        ++*(size_t *)arg;
+    }
+}
+
+// #################### Main
+
+int
+main(int argc, char **argv)
+{
+    const char *xml_fname = "../cmd/isbn-range.xml";
+    isbn_info_t *isbn;
+    isbn_prefix_t *pfxtbl;
+    fst_t *builder;
+    fst_t *fst;
+    char *isbnv;
+    uint64_t *u64v;
+    const char **keyv;
+    const char **pkeyv;
+    val_t *valv;
+    int *errv;
+    uint32_t *latv;
+    size_t nlookups = 1000000;
+    size_t nprefixes;
+    size_t nfound;
+    size_t i;
+    double t0, t1;
+    char hbuf[32];
+    char *textv;
+    isbn_push_t *push;
+    size_t off;
+    struct rusage ru;
+    isbn_corpus_opts_t gen_opts = { ISBN_DIST_WEIGHTED, 0.0, 0.0, 0.0, 0 };
+    isbn_corpus_t *gen;
+    size_t pnr;
+    int optc;
+
+    eprint_fh = stderr;
+    dprint_fh = stderr;
+    program_path = argv[0];
+
+    while ((optc = getopt(argc, argv, "x:n:s:")) != -1) {
+        switch (optc) {
+        case 'x':
+            xml_fname = optarg;
+            break;
+        case 'n':
+            nlookups = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            gen_opts.seed = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr,
+                "usage: bench-isbn [ -x <xml> ] [ -n <nlookups> ] [ -s <seed> ]\n");
+            exit(2);
+        }
+    }
+    if (nlookups == 0) {
+        nlookups = 1;
+    }
+
+    // ---------- Load, build, pack
+
+    t0 = now();
+    isbn = parse_isbn_range_table(xml_fname);
+    t1 = now();
+    if (isbn == NULL) {
+        fprintf(stderr, "Could not load '%s'.\n", xml_fname);
+        exit(2);
+    }
+    metric("table_load_time", t1 - t0, "s");
+
+    pfxtbl = (isbn_prefix_t *)isbn->prefix_vec.base;
+    nprefixes = isbn->prefix_vec.len;
+    metric("prefixes", nprefixes, "entries");
+    metric("ranges", isbn->ranges_vec.len, "entries");
+
+    t0 = now();
+    builder = fst_new();
+    for (i = 0; i < nprefixes; ++i) {
+        fst_add_string(builder, pfxtbl[i].prefix, i);
+    }
+    t1 = now();
+    metric("fst_build_time", t1 - t0, "s");
+
+    t0 = now();
+    fst = fst_copy_and_pack(builder);
+    t1 = now();
+    metric("fst_pack_time", t1 - t0, "s");
+    metric("fst_jump_depth", fst_jump_depth(fst), "steps");
+    metric("fst_packed_bytes", fst_measure(fst), "bytes");
+    metric("prefix_table_bytes",
+        isbn->prefix_vec.len * isbn->prefix_vec.esize, "bytes");
+    metric("range_table_bytes",
+        isbn->ranges_vec.len * isbn->ranges_vec.esize, "bytes");
+
+    // ---------- Inputs
+
+    isbnv = malloc(nlookups * ISBN_SZ);
+    u64v  = malloc(nlookups * sizeof (uint64_t));
+    keyv  = malloc(nlookups * sizeof (char *));
+    pkeyv = malloc(nlookups * sizeof (char *));
+    valv  = malloc(nlookups * sizeof (val_t));
+    errv  = malloc(nlookups * sizeof (int));
+    latv  = malloc(nlookups * sizeof (uint32_t));
+    if (!isbnv || !u64v || !keyv || !pkeyv || !valv || !errv || !latv) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(64);
+    }
+
+    gen = isbn_corpus_new(isbn, &gen_opts);
+    pnr = 0;
+    for (i = 0; i < nlookups; ++i) {
+        isbn_corpus_next(gen, isbnv + i * ISBN_SZ);
+        keyv[i] = isbnv + i * ISBN_SZ;
+        u64v[i] = strtoull(keyv[i], NULL, 10);
+        pkeyv[i] = pfxtbl[pnr].prefix;
+        pnr = (pnr + 7) % nprefixes;
+    }
+    isbn_corpus_free(gen);
+    calibrate_timer(latv, nlookups);
+    metric("timer_overhead", timer_overhead, "ns");
+
+    // ---------- fst_lookup_string(), on whole prefixes
+
+    nfound = 0;
+    t0 = now();
+    for (i = 0; i < nlookups; ++i) {
+        nfound += (fst_lookup_string(isbn->fst, pkeyv[i], &valv[i]) == 0);
+    }
+    t1 = now();
+    report_rate("fst_lookup_string", nlookups, t1 - t0);
+    for (i = 0; i < nlookups; ++i) {
+        uint64_t ts = now_ns();
+        fst_lookup_string(isbn->fst, pkeyv[i], &valv[i]);
+        latv[i] = (uint32_t)(now_ns() - ts);
+    }
+    report_latency("fst_lookup_string", latv, nlookups);
+    if (nfound != nlookups) {
+        fprintf(stderr, "fst_lookup_string: only %zu of %zu found.\n",
+            nfound, nlookups);
+        exit(1);
+    }
+
+    // ---------- fst_lookup_prefix(), on ISBN-13s
+
+    t0 = now();
+    for (i = 0; i < nlookups; ++i) {
+        fst_lookup_prefix(isbn->fst, keyv[i], &valv[i]);
+    }
+    t1 = now();
+    report_rate("fst_lookup_prefix", nlookups, t1 - t0);
+    for (i = 0; i < nlookups; ++i) {
+        uint64_t ts = now_ns();
+        fst_lookup_prefix(isbn->fst, keyv[i], &valv[i]);
+        latv[i] = (uint32_t)(now_ns() - ts);
+    }
+    report_latency("fst_lookup_prefix", latv, nlookups);
+
+    t0 = now();
+    fst_lookup_prefix_batch(isbn->fst, keyv, nlookups, valv, errv);
+    t1 = now();
+    report_rate("fst_lookup_prefix_batch", nlookups, t1 - t0);
+
+    // ---------- hyphenate_isbn()
+
+    nfound = 0;
+    t0 = now();
+    for (i = 0; i < nlookups; ++i) {
+        nfound += (hyphenate_isbn(isbn, hbuf, sizeof (hbuf), keyv[i]) == 0);
+    }
+    t1 = now();
+    report_rate("hyphenate_isbn", nlookups, t1 - t0);
+    for (i = 0; i < nlookups; ++i) {
+        uint64_t ts = now_ns();
+        hyphenate_isbn(isbn, hbuf, sizeof (hbuf), keyv[i]);
+        latv[i] = (uint32_t)(now_ns() - ts);
+    }
+    report_latency("hyphenate_isbn", latv, nlookups);
+    if (nfound != nlookups) {
+        fprintf(stderr, "hyphenate_isbn: only %zu of %zu hyphenated.\n",
+            nfound, nlookups);
+        exit(1);
+    }
+
+    t0 = now();
+    for (i = 0; i < nlookups; ++i) {
+        hyphenate_isbn_u64(isbn, hbuf, sizeof (hbuf), u64v[i]);
+    }
+    t1 = now();
+    report_rate("hyphenate_isbn_u64", nlookups, t1 - t0);
+    for (i = 0; i < nlookups; ++i) {
+        uint64_t ts = now_ns();
+        hyphenate_isbn_u64(isbn, hbuf, sizeof (hbuf), u64v[i]);
+        latv[i] = (uint32_t)(now_ns() - ts);
+    }
+    report_latency("hyphenate_isbn_u64", latv, nlookups);
+
+    // ---------- isbn_push_feed(), on one text stream, in chunks
+
+    textv = malloc(nlookups * ISBN_SZ);
+    if (textv == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        exit(64);
+    }
+    for (i = 0; i < nlookups; ++i) {
+        memcpy(textv + i * ISBN_SZ, keyv[i], ISBN_SZ - 1);
+        textv[i * ISBN_SZ + ISBN_SZ - 1] = '\n';
+    }
+    nfound = 0;
+    push = isbn_push_new(isbn, '\n', push_count, &nfound);
+    t0 = now();
+    for (off = 0; off < nlookups * ISBN_SZ; off += PUSH_CHUNK) {
+        size_t n = nlookups * ISBN_SZ - off;
+
+        isbn_push_feed(push, textv + off, n < PUSH_CHUNK ? n : PUSH_CHUNK);
+    }
+    isbn_push_finish(push);
+    t1 = now();
+    report_rate("isbn_push_feed", nlookups, t1 - t0);
+    if (nfound != nlookups || push->nrecords != nlookups) {
+        fprintf(stderr, "isbn_push_feed: only %zu of %zu hyphenated.\n",
+            nfound, nlookups);
+        exit(1);
+    }
+    isbn_push_free(push);
+    free(textv);
+
+    // ---------- Footprint
+
+    getrusage(RUSAGE_SELF, &ru);
+    metric("peak_rss", (double)ru.ru_maxrss * 1024, "bytes");
+
+    exit(0);
+}
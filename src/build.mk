@@ -0,0 +1,93 @@
+# Filename: src/build.mk
+# Project: isbn-hyphenate
+# Brief: Build variants, shared by all the Makefiles under src/
+#
+# Copyright (C) 2016-2020 Guy Shaw
+# Written by Guy Shaw <gshaw@acm.org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as
+# published by the Free Software Foundation; either version 3 of the
+# License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Select a variant with BUILD=<variant>, for example
+#
+#     make BUILD=profile
+#
+# release       Optimized, link-time optimization, no instrumentation.
+#               This is what gets installed.
+# profile       Optimized, but with frame pointers and full symbols,
+#               for perf(1) and other sampling profilers.
+# instrumented  -finstrument-functions on every function, for uftrace
+#               and friends.  This is the old default build.
+# pgo-gen       release, plus profile counters written to $(PGO_DIR).
+# pgo-use       release, optimized using the profile in $(PGO_DIR).
+#               `make pgo` in src/ drives both.
+#
+# Each directory keeps a .build-<variant> stamp, and everything
+# depends on it, so switching variants rebuilds from scratch.
+#
+# Include this after setting CC, so that AR matches the compiler;
+# archives of LTO objects need the compiler's own ar wrapper.
+
+BUILD ?= release
+PGO_DIR ?= $(abspath $(dir $(lastword $(MAKEFILE_LIST))))/tmp/pgo
+
+ifeq ($(BUILD),release)
+CONFIG  := -O2 -g -flto
+LDFLAGS_BUILD := -flto
+else ifeq ($(BUILD),profile)
+CONFIG  := -O2 -ggdb -g3 -fno-omit-frame-pointer
+LDFLAGS_BUILD :=
+else ifeq ($(BUILD),instrumented)
+CONFIG  := -DDEBUG -ggdb -g3 -finstrument-functions
+LDFLAGS_BUILD :=
+else ifeq ($(BUILD),pgo-gen)
+CONFIG  := -O2 -g -flto -fprofile-generate=$(PGO_DIR)
+LDFLAGS_BUILD := -flto -fprofile-generate=$(PGO_DIR)
+else ifeq ($(BUILD),pgo-use)
+ifneq ($(findstring clang,$(CC)),)
+PGO_USE := -fprofile-use=$(PGO_DIR)/default.profdata -Wno-profile-instr-unprofiled
+else
+PGO_USE := -fprofile-use=$(PGO_DIR) -fprofile-partial-training -Wno-missing-profile
+endif
+CONFIG  := -O2 -g -flto $(PGO_USE)
+LDFLAGS_BUILD := -flto $(PGO_USE)
+else
+$(error Unknown BUILD '$(BUILD)'; use release, profile, instrumented, pgo-gen, or pgo-use)
+endif
+
+# Compressed input and output (see zstream.h) always have gzip,
+# through zlib.  ZSTD=1 adds zstd, which needs libzstd and its headers.
+# Switching it does not rebuild by itself; make clean first.
+
+ZSTD ?= 0
+ifeq ($(ZSTD),1)
+CONFIG  += -DHAVE_ZSTD
+LIBS_Z  := -lz -lzstd -lpthread
+else
+LIBS_Z  := -lz -lpthread
+endif
+
+ifneq ($(findstring clang,$(CC)),)
+AR := llvm-ar
+else
+AR := gcc-ar
+endif
+
+BUILD_STAMP := .build-$(BUILD)
+
+$(BUILD_STAMP):
+	rm -f .build-*
+	touch $@
+
+# Do not let the stamp rule become the default goal of the includer.
+.DEFAULT_GOAL :=
@@ -30,6 +30,17 @@
     // Import err()
 #include <errno.h>
     // Import var errno
+#include <inttypes.h>
+    // Import PRIu64
+#include <poll.h>
+    // Import poll()
+    // Import type struct pollfd
+    // Import constant POLLIN
+#include <signal.h>
+    // Import sigaction()
+    // Import type sig_atomic_t
+    // Import constant SIGUSR1
+    // Import constant SIGUSR2
 #include <stdbool.h>
     // Import type bool
     // Import constant false
@@ -42,7 +53,9 @@
     // Import fopen()
     // Import fprintf()
     // Import fputc()
+    // Import fflush()
     // Import fputs()
+    // Import setvbuf()
     // Import snprintf()
     // Import var stdin
     // Import var stdout
@@ -50,22 +63,32 @@
     // Import exit()
     // Import free()
 #include <string.h>
+    // Import memcpy()
+    // Import memmove()
+    // Import strcmp()
     // Import strdup()
+    // Import strlen()
+#include <time.h>
+    // Import clock_gettime()
 #include <unistd.h>
     // Import getopt_long()
     // Import optarg()
     // Import opterr()
     // Import optind()
     // Import optopt()
+    // Import read()
     // Import type size_t
+    // Import write()
 
+#include <aread.h>
 #include <cscript.h>
 #include <fprint.h>
 #include <isbn-info.h>
+#include <isbn-lat.h>
+#include <isbn-stats.h>
 #include <libfst.h>
-
-extern isbn_info_t *parse_isbn_range_table(const char *docname);
-extern int hyphenate_isbn(isbn_info_t *, char *hbuf, size_t bsz, const char *isbn);
+#include <recbuf.h>
+#include <zstream.h>
 
 const char *program_path;
 const char *program_name;
@@ -81,6 +104,63 @@ static isbn_info_t *isbn_info;
 bool verbose  = false;
 bool debug    = false;
 bool opt_argv = false;
+bool opt_stats = false;
+bool opt_stats_json = false;
+size_t opt_lat_every = 0;
+bool opt_mem_report = false;
+bool opt_protect_tables = false;
+
+enum out_format {
+    FMT_TEXT,       // Hyphenated ISBN only
+    FMT_TSV,        // Hyphenated ISBN, elements, agency, rule
+    FMT_JSON,       // Same as TSV, as one JSON object per line
+    FMT_BIN,        // Fixed-width binary records; see isbn_bin_rec_put()
+    FMT_PACKED      // One uint64_t per record; see isbn_pack_u64()
+};
+
+enum in_format {
+    IN_TEXT,        // Delimited records
+    IN_U64,         // Fixed-width binary: uint64_t, in host byte order
+    IN_ISBN13,      // Fixed-width binary: 13 ASCII digits, no delimiter
+    IN_PACKED       // Fixed-width binary: uint64_t, as from --format=packed
+};
+
+static enum in_format opt_input = IN_TEXT;
+
+static enum out_format opt_format = FMT_TEXT;
+
+// --annotate: one output record for every input record, with a status.
+static bool opt_annotate = false;
+
+// Input record delimiter; output records end with the same byte.
+static int opt_delim = '\n';
+
+// --field: which field of each record to hyphenate, from 1; 0 for none.
+static size_t opt_field = 0;
+static int opt_separator = ',';
+
+// --readahead: reads in flight, across the input files; 0 for off.
+static size_t opt_readahead = 0;
+
+// --decompress, --compress, --codec-threads; see zstream.h.
+static zs_codec_t opt_decompress = ZS_AUTO;
+static zs_codec_t opt_compress = ZS_NONE;
+static int opt_compress_level = -1;
+static size_t opt_codec_threads = 0;
+static zout_t *zout = NULL;
+
+// Where text output goes: stdout, or, with --compress, a stream
+// that writes into |zout|; see compress_start().
+static FILE *out;
+
+// --coprocess: flush answers whenever input runs dry; see coprocess_read().
+static bool opt_coprocess = false;
+static int coprocess_fd = -1;
+
+static isbn_stats_t *stats;
+static isbn_lat_t *lat_hists;
+static volatile sig_atomic_t stats_requested = 0;
+static volatile sig_atomic_t lat_toggle_requested = 0;
 
 static struct option long_options[] = {
     {"help",     no_argument, 0,'h'},
@@ -88,6 +168,22 @@ static struct option long_options[] = {
     {"verbose",  no_argument, 0,'v'},
     {"debug",    no_argument, 0,'d'},
     {"argv",     no_argument, 0,'A'},
+    {"stats",    optional_argument, 0, 'S'},
+    {"latency",  optional_argument, 0, 'L'},
+    {"mem-report", no_argument, 0, 'M'},
+    {"protect-tables", no_argument, 0, 'P'},
+    {"format",   required_argument, 0, 'F'},
+    {"input",    required_argument, 0, 'I'},
+    {"annotate", no_argument, 0, 'a'},
+    {"zero-terminated", no_argument, 0, 'z'},
+    {"delimiter", required_argument, 0, 'D'},
+    {"field",    required_argument, 0, 'f'},
+    {"separator", required_argument, 0, 's'},
+    {"readahead", optional_argument, 0, 'R'},
+    {"decompress", required_argument, 0, 'U'},
+    {"compress", required_argument, 0, 'C'},
+    {"codec-threads", required_argument, 0, 'T'},
+    {"coprocess", no_argument, 0, 'c'},
     {0, 0, 0, 0}
 };
 
@@ -98,6 +194,66 @@ static const char usage_text[] =
     "  --verbose|-v         verbose\n"
     "  --debug|-d           debug\n"
     "  --argv               Input is argv, instead of from files\n"
+    "  --stats[=text|json]  Print counters to stderr at exit, and on SIGUSR1\n"
+    "  --latency[=N]        Time 1 in N lookups (default 64); print latency\n"
+    "                       histograms at exit, and on SIGUSR1.\n"
+    "                       SIGUSR2 turns sampling off and on.\n"
+    "  --mem-report         Print memory used by the tables, by structure\n"
+    "  --protect-tables     Make the tables read-only, once loaded\n"
+    "  --format=text|tsv|json|bin|packed\n"
+    "                       text: the hyphenated ISBN (default).\n"
+    "                       tsv: input, hyphenated, prefix, group, registrant,\n"
+    "                       publication, check digit, agency id, agency, rule.\n"
+    "                       json: the same, one object per line.\n"
+    "                       bin: 10-byte records; the ISBN as a uint64_t,\n"
+    "                       then 4 hyphen positions, as 4-bit fields\n"
+    "                       of a uint16_t; host byte order.\n"
+    "                       packed: 8-byte records; the ISBN, group length,\n"
+    "                       and registrant length, in one uint64_t.\n"
+    "  --input=text|u64|isbn13|packed\n"
+    "                       text: delimited records (default).\n"
+    "                       u64: 8-byte records, each an ISBN as a uint64_t,\n"
+    "                       in host byte order.\n"
+    "                       isbn13: 13-byte records of 13 digits,\n"
+    "                       with no delimiter.\n"
+    "                       packed: as written by --format=packed;\n"
+    "                       with --format=text, expanded without lookup.\n"
+    "  --annotate           Print one record for every input record,\n"
+    "                       failures included, with a status code:\n"
+    "                       OK, LEN (not 13 digits), CHK (bad check digit),\n"
+    "                       PFX (unknown group), RNG (unassigned range).\n"
+    "                       text: input, hyphenated or empty, status.\n"
+    "                       tsv, json: a status column is added.\n"
+    "                       --field: the status is added as a last field.\n"
+    "                       bin: failures are written, with hyphens 0.\n"
+    "  --zero-terminated|-z Records end with NUL, not newline,\n"
+    "                       on input and on output\n"
+    "  --delimiter=C        Records end with the byte C, on input and\n"
+    "                       on output.  C may be \\0, \\t, \\n, or \\r.\n"
+    "  --field=N            Hyphenate only field N (from 1) of each record,\n"
+    "                       in place; copy everything else through.\n"
+    "                       A record whose field is not a valid ISBN-13\n"
+    "                       is copied through unchanged.\n"
+    "  --separator=C        Fields are separated by C (default ',').\n"
+    "                       Fields may be \"quoted\", as in CSV.\n"
+    "  --readahead[=N]      Keep N reads (default 8) in flight, ahead of\n"
+    "                       the lookups, across the input files; use\n"
+    "                       io_uring, if the kernel allows it.\n"
+    "                       Files are opened only as they are reached.\n"
+    "  --decompress=auto|gzip|zstd|none\n"
+    "                       How to read input.  auto (default): gzip and\n"
+    "                       zstd are recognized by their first bytes;\n"
+    "                       not for --input=u64 or --input=packed.\n"
+    "                       Decoding runs on a thread of its own.\n"
+    "  --compress=gzip|zstd[:LEVEL]\n"
+    "                       Compress the output, a block at a time,\n"
+    "                       on --codec-threads threads.\n"
+    "  --codec-threads=N    Threads for --compress (default: one per CPU,\n"
+    "                       up to 8).\n"
+    "  --coprocess          For a program that talks to this one over\n"
+    "                       pipes: answers are sent as soon as there is\n"
+    "                       no more input waiting, and batched while\n"
+    "                       there is.  Input is not decompressed.\n"
     ;
 
 static const char version_text[] =
@@ -161,76 +317,1140 @@ vischar_r(char *buf, size_t sz, int c)
     return (buf);
 }
 
-// ################ linebuf
+// ################ Statistics
 
-struct linebuf {
-    FILE   *f;
-    char   *buf;
-    void   *sgl;
-    size_t siz;
+static inline uint64_t
+now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void
+sigusr1_handler(int sig)
+{
+    (void)sig;
+    stats_requested = 1;
+}
+
+static void
+sigusr2_handler(int sig)
+{
+    (void)sig;
+    lat_toggle_requested = 1;
+}
+
+static void
+report(void)
+{
+    if (opt_stats) {
+        fprint_isbn_stats(stderr, stats, isbn_info, opt_stats_json);
+    }
+    if (lat_hists != NULL) {
+        fdump_isbn_lat(stderr, lat_hists);
+    }
+}
+
+/*
+ * Parse the argument to --delimiter: a single byte,
+ * or a backslash escape for one of the usual control characters.
+ * Return the byte, or -1.
+ */
+static int
+parse_delimiter(const char *str)
+{
+    if (str[0] != '\0' && str[1] == '\0') {
+        return ((unsigned char)str[0]);
+    }
+    if (str[0] == '\\' && str[1] != '\0' && str[2] == '\0') {
+        switch (str[1]) {
+        case '0':  return ('\0');
+        case 't':  return ('\t');
+        case 'n':  return ('\n');
+        case 'r':  return ('\r');
+        case '\\': return ('\\');
+        }
+    }
+    return (-1);
+}
+
+static int
+parse_codec(const char *str, zs_codec_t *codec_ref)
+{
+    static const zs_codec_t codecv[] = { ZS_NONE, ZS_AUTO, ZS_GZIP, ZS_ZSTD };
+    size_t i;
+
+    for (i = 0; i < sizeof (codecv) / sizeof (codecv[0]); ++i) {
+        if (strcmp(str, zs_codec_name(codecv[i])) == 0) {
+            *codec_ref = codecv[i];
+            return (0);
+        }
+    }
+    return (EINVAL);
+}
+
+/*
+ * Parse --compress=CODEC[:LEVEL].
+ */
+static int
+parse_compress(const char *str)
+{
+    char codec_name[8];
+    const char *colon;
+    size_t level;
     size_t len;
-    int    err;
-    bool   eof;
+    int rv;
+
+    colon = strchr(str, ':');
+    len = colon != NULL ? (size_t)(colon - str) : strlen(str);
+    if (len >= sizeof (codec_name)) {
+        return (EINVAL);
+    }
+    memcpy(codec_name, str, len);
+    codec_name[len] = '\0';
+    rv = parse_codec(codec_name, &opt_compress);
+    if (rv != 0 || opt_compress == ZS_AUTO) {
+        return (EINVAL);
+    }
+    opt_compress_level = -1;
+    if (colon != NULL) {
+        rv = parse_cardinal(&level, colon + 1);
+        if (rv != 0 || level > 22) {
+            return (EINVAL);
+        }
+        opt_compress_level = (int)level;
+    }
+    return (0);
+}
+
+/*
+ * Printing is not async-signal-safe, so the handlers only set flags,
+ * and the main loop acts on them, between lines.
+ */
+static inline void
+signals_poll(void)
+{
+    if (stats_requested) {
+        stats_requested = 0;
+        report();
+    }
+    if (lat_toggle_requested) {
+        lat_toggle_requested = 0;
+        isbn_lat_set(isbn_lat_current ? NULL : lat_hists);
+    }
+}
+
+static void
+on_signal(int sig, void (*handler)(int))
+{
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof (sa));
+    sa.sa_handler = handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(sig, &sa, NULL);
+}
+
+static void
+report_start(void)
+{
+    if (opt_stats) {
+        stats = isbn_stats_new(isbn_info);
+    }
+    if (opt_lat_every != 0) {
+        lat_hists = isbn_lat_new(opt_lat_every);
+        isbn_lat_set(lat_hists);
+        on_signal(SIGUSR2, sigusr2_handler);
+    }
+    on_signal(SIGUSR1, sigusr1_handler);
+}
+
+/*
+ * Print one output record, ended by the record delimiter.
+ */
+static inline void
+print_rec(const char *str)
+{
+    fputs(str, out);
+    fputc(opt_delim, out);
+}
+
+static const char *elem_namev[ISBN_NELEMENTS] = {
+    "prefix",
+    "group",
+    "registrant",
+    "publication",
+    "check",
 };
 
-typedef struct linebuf linebuf_t;
+/*
+ * Print the result of a lookup as one record, in the form
+ * chosen by --format.  With --annotate, also print failures,
+ * with empty columns for whatever was not found, and a status
+ * code; see isbn_status_code().  Return the number of bytes written.
+ */
+static size_t
+print_lookup(const char *isbn_str, const isbn_lookup_t *res, int rv)
+{
+    const char *h = res->hyphenated;
+    size_t n;
+    int i;
 
-extern linebuf_t *linebuf_new(void);
-extern void linebuf_init(linebuf_t *lbuf, FILE *f);
-extern void linebuf_sgl_new(linebuf_t *lbuf);
-extern void linebuf_free(linebuf_t *lbuf);
-extern char *sgl_fgetline(linebuf_t *lbuf, int endl);
+    n = 0;
+    if (opt_format == FMT_TEXT) {
+        // Only with --annotate
+        n += fprintf(out, "%s\t%s\t%s%c",
+            isbn_str, h, isbn_status_code(rv), opt_delim);
+        return (n);
+    }
 
+    if (opt_format == FMT_TSV) {
+        n += fprintf(out, "%s\t%s", isbn_str, h);
+        for (i = 0; i < ISBN_NELEMENTS; ++i) {
+            if (rv == 0) {
+                n += fprintf(out, "\t%.*s", res->elem_len[i],
+                    h + res->elem_off[i]);
+            }
+            else {
+                n += fprintf(out, "\t");
+            }
+        }
+        if (res->agency != NULL) {
+            n += fprintf(out, "\t%u\t%s", res->agency_id, res->agency);
+        }
+        else {
+            n += fprintf(out, "\t\t");
+        }
+        if (rv == 0) {
+            n += fprintf(out, "\t%zu", res->rule_nr);
+        }
+        else {
+            n += fprintf(out, "\t");
+        }
+        if (opt_annotate) {
+            n += fprintf(out, "\t%s", isbn_status_code(rv));
+        }
+        fputc(opt_delim, out);
+        return (n + 1);
+    }
+
+    n += fprintf(out, "{\"isbn\":");
+    n += fputs_json(out, isbn_str);
+    if (rv == 0) {
+        n += fprintf(out, ",\"hyphenated\":\"%s\"", h);
+        for (i = 0; i < ISBN_NELEMENTS; ++i) {
+            n += fprintf(out, ",\"%s\":\"%.*s\"", elem_namev[i],
+                res->elem_len[i], h + res->elem_off[i]);
+        }
+    }
+    if (res->agency != NULL) {
+        n += fprintf(out, ",\"agency_id\":%u,\"agency\":", res->agency_id);
+        n += fputs_json(out, res->agency);
+    }
+    if (rv == 0) {
+        n += fprintf(out, ",\"rule\":%zu", res->rule_nr);
+    }
+    if (opt_annotate) {
+        n += fprintf(out, ",\"status\":\"%s\"", isbn_status_code(rv));
+    }
+    n += fprintf(out, "}%c", opt_delim);
+    return (n);
+}
+
+/*
+ * Look up one ISBN; with --annotate, validate it first.
+ * Otherwise, only make sure that it is 13 digits; records are
+ * looked up in place, and the lookup reads 13 bytes, regardless.
+ */
+static inline int
+lookup(const char *isbn_str, size_t len, isbn_lookup_t *res)
+{
+    if (opt_annotate) {
+        return (isbn_check_and_lookup(isbn_info, isbn_str, len, res));
+    }
+    if (isbn_check_form(isbn_str, len) != 0) {
+        res->prefix_nr = UNDEF_INDEX;
+        return (EINVAL);
+    }
+    return (isbn_lookup(isbn_info, isbn_str, res));
+}
+
+/*
+ * Same as hyphenate_one(), but for --format=tsv or json,
+ * or --annotate.
+ */
 static void
-fgetline(linebuf_t *lbuf)
+lookup_one(const char *isbn_str, size_t len)
 {
-    char *rbuf;
+    isbn_lookup_t res;
+    uint64_t t0, t1, t2;
+    size_t nout;
+    int rv;
 
-    // Free up any resources leftover from the last time
-    // this line buffer was used.
-    //
-    // In particlur, free up any segments of a scatter/gather list
-    // and the line buffer.
+    if (!opt_stats) {
+        rv = lookup(isbn_str, len, &res);
+        if (rv == 0 || opt_annotate) {
+            print_lookup(isbn_str, &res, rv);
+        }
+        if (lat_hists != NULL) {
+            signals_poll();
+        }
+        return;
+    }
 
-    linebuf_free(lbuf);
+    ++stats->lines;
+    stats->bytes_in += len + 1;
+    t0 = now_ns();
+    rv = lookup(isbn_str, len, &res);
+    t1 = now_ns();
+    isbn_stats_count(stats, rv, res.prefix_nr);
+    if (rv == 0 || opt_annotate) {
+        nout = print_lookup(isbn_str, &res, rv);
+        stats->bytes_out += nout;
+    }
+    t2 = now_ns();
+    stats->ns_lookup += t1 - t0;
+    stats->ns_output += t2 - t1;
+    signals_poll();
+}
 
-    linebuf_sgl_new(lbuf);
+// ################ binary records
 
-    rbuf = sgl_fgetline(lbuf, '\n');
-    (void)rbuf;
+/*
+ * Binary output bypasses stdio.  Records are gathered into one block,
+ * which is written with write(2) when it is full, and at the end.
+ */
+
+#define BIN_BLOCK_SIZE (64 * 1024)
+
+static char binout_buf[BIN_BLOCK_SIZE - BIN_BLOCK_SIZE % ISBN_BIN_REC_SIZE];
+static size_t binout_len = 0;
+static int binout_err = 0;
+
+static void
+binout_flush(void)
+{
+    size_t off;
+    ssize_t n;
+
+    if (zout != NULL) {
+        if (binout_err == 0) {
+            binout_err = zout_write(zout, binout_buf, binout_len);
+        }
+        binout_len = 0;
+        return;
+    }
+    off = 0;
+    while (off < binout_len && binout_err == 0) {
+        n = write(STDOUT_FILENO, binout_buf + off, binout_len - off);
+        if (n < 0) {
+            if (errno != EINTR) {
+                binout_err = errno;
+            }
+            continue;
+        }
+        off += n;
+    }
+    binout_len = 0;
 }
 
-int
-isbn_stream(const char *fname, FILE *f)
+/*
+ * Make room for one record of |size| bytes, and return where it goes.
+ */
+static inline char *
+binout_next(size_t size)
+{
+    char *rec;
+
+    if (binout_len + size > sizeof (binout_buf)) {
+        binout_flush();
+    }
+    rec = binout_buf + binout_len;
+    binout_len += size;
+    return (rec);
+}
+
+static inline bool
+out_is_bin(void)
 {
-    (void)fname;    // We will use later for error reporting.
+    return (opt_format == FMT_BIN || opt_format == FMT_PACKED);
+}
+
+// ################ compressed output
+
+/*
+ * Start --compress.  From here on, |out| is a stdio stream that
+ * writes into |zout|, so everything that prints to |out| is
+ * compressed, without knowing it; binary output goes straight
+ * to |zout|, from binout_flush().
+ */
+static int
+compress_start(void)
+{
+    FILE *f;
+    int rv;
+
+    rv = zout_open(&zout, STDOUT_FILENO, opt_compress, opt_compress_level,
+        (unsigned int)opt_codec_threads);
+    if (rv != 0) {
+        eprintf("%s: --compress=%s failed, errno=%d\n", program_name,
+            zs_codec_name(opt_compress), rv);
+        return (rv);
+    }
+    fflush(out);
+    f = zout_fopen(zout);
+    if (f == NULL) {
+        rv = errno;
+        zout_close(zout);
+        zout = NULL;
+        return (rv);
+    }
+    setvbuf(f, NULL, _IOFBF, BIN_BLOCK_SIZE);
+    out = f;
+    return (0);
+}
+
+/*
+ * Flush what is left, wait for the compressor threads to write it
+ * all, and point |out| back at stdout.
+ */
+static int
+compress_finish(void)
+{
+    int err;
+
+    err = 0;
+    if (fclose(out) != 0) {
+        err = errno;
+    }
+    out = stdout;
+    if (err == 0) {
+        err = zout_close(zout);
+    }
+    else {
+        zout_close(zout);
+    }
+    zout = NULL;
+    return (err);
+}
+
+/*
+ * Convert an ISBN-13 from 13 digits of text to a number.
+ * With --annotate, also check the check digit, as isbn_validate() does.
+ */
+static inline int
+isbn_from_str(const char *isbn_str, size_t len, uint64_t *isbn13_ref)
+{
+    uint64_t n;
+    unsigned int d;
+    size_t i;
+    int rv;
+
+    *isbn13_ref = 0;
+    if (opt_annotate) {
+        rv = isbn_validate(isbn_str, len);
+        if (rv) {
+            return (rv);
+        }
+    }
+    else if (len != 13) {
+        return (EINVAL);
+    }
+    n = 0;
+    for (i = 0; i < 13; ++i) {
+        d = (unsigned char)isbn_str[i] - '0';
+        if (d > 9) {
+            return (EINVAL);
+        }
+        n = n * 10 + d;
+    }
+    *isbn13_ref = n;
+    return (0);
+}
+
+static inline int
+isbn_validate_u64(uint64_t isbn13)
+{
+    char digits[24];
+    int n;
+
+    n = snprintf(digits, sizeof (digits), "%013" PRIu64, isbn13);
+    return (isbn_validate(digits, n));
+}
+
+/*
+ * Look up one numeric ISBN-13, and write a binary record for it,
+ * in the form chosen by --format.
+ * |rv| is the outcome of converting the input record;
+ * if it is not 0, there is nothing to look up.
+ * |inlen| is the size of the input record, for --stats.
+ */
+static inline void
+bin_one(uint64_t isbn13, int rv, size_t inlen)
+{
+    uint16_t hyphens = 0;
+    uint64_t packed = isbn13;
+    size_t prefix_nr = UNDEF_INDEX;
+    size_t nout;
+    uint64_t t0 = 0;
+
+    if (rv == 0) {
+        if (opt_stats) {
+            t0 = now_ns();
+        }
+        if (opt_format == FMT_PACKED) {
+            rv = isbn_pack_u64(isbn_info, isbn13, &packed, &prefix_nr);
+        }
+        else {
+            rv = isbn_hyphens_u64(isbn_info, isbn13, &hyphens, &prefix_nr);
+        }
+        if (opt_stats) {
+            stats->ns_lookup += now_ns() - t0;
+        }
+    }
+    if (opt_stats) {
+        ++stats->lines;
+        stats->bytes_in += inlen;
+        isbn_stats_count(stats, rv, prefix_nr);
+    }
+    if (rv == 0 || opt_annotate) {
+        if (opt_format == FMT_PACKED) {
+            nout = sizeof (packed);
+            memcpy(binout_next(nout), &packed, nout);
+        }
+        else {
+            nout = ISBN_BIN_REC_SIZE;
+            isbn_bin_rec_put(binout_next(nout), isbn13, hyphens);
+        }
+        if (opt_stats) {
+            stats->bytes_out += nout;
+        }
+    }
+}
+
+/*
+ * Hyphenate one ISBN and print the result, counting it,
+ * if --stats was given.
+ */
+static inline void
+hyphenate_one(const char *isbn_str, size_t len, isbn_lat_t *lat)
+{
+    char hbuf[32];
+    uint64_t t0, t1, t2;
+    uint64_t t;
+    size_t prefix_nr;
+    int rv;
+
+    if (out_is_bin()) {
+        uint64_t isbn13;
+
+        rv = isbn_from_str(isbn_str, len, &isbn13);
+        bin_one(isbn13, rv, len + 1);
+        return;
+    }
+
+    if (opt_format != FMT_TEXT || opt_annotate) {
+        lookup_one(isbn_str, len);
+        return;
+    }
+
+    // Records are in place; the lookup must not read past a short one.
+    rv = isbn_check_form(isbn_str, len);
+
+    if (!opt_stats) {
+        if (rv == 0) {
+            rv = hyphenate_isbn(isbn_info, hbuf, sizeof (hbuf), isbn_str);
+        }
+        if (rv == 0) {
+            if (lat != NULL) {
+                t = isbn_lat_now();
+            }
+            print_rec(hbuf);
+            isbn_lat_phase(lat, ISBN_LAT_WRITE, &t);
+        }
+        if (lat_hists != NULL) {
+            signals_poll();
+        }
+        return;
+    }
+
+    ++stats->lines;
+    stats->bytes_in += len + 1;
+    t0 = now_ns();
+    prefix_nr = UNDEF_INDEX;
+    if (rv == 0) {
+        rv = hyphenate_isbn_ex(isbn_info, hbuf, sizeof (hbuf), isbn_str,
+            &prefix_nr);
+    }
+    t1 = now_ns();
+    isbn_stats_count(stats, rv, prefix_nr);
+    if (rv == 0) {
+        print_rec(hbuf);
+        stats->bytes_out += strlen(hbuf) + 1;
+    }
+    t2 = now_ns();
+    stats->ns_lookup += t1 - t0;
+    stats->ns_output += t2 - t1;
+    if (lat != NULL && rv == 0) {
+        lat_hist_record(&lat->histv[ISBN_LAT_WRITE], t2 - t1);
+    }
+    signals_poll();
+}
+
+// ################ field mode
+
+/*
+ * Find field number |n| (counting from 1) of |rec|,
+ * where fields are separated by |sep|.
+ *
+ * A field that begins with a double quote runs to the matching
+ * closing quote; inside it, |sep| does not end the field,
+ * and "" stands for one quote character.
+ * The record delimiter cannot be quoted; it always ends the record.
+ *
+ * @return  0, and [*beg_ref, *end_ref) is the field, quotes and all,
+ *          or ENOENT, if the record has fewer than |n| fields.
+ */
+static int
+find_field(const char *rec, size_t len, size_t n, int sep,
+    size_t *beg_ref, size_t *end_ref)
+{
+    const char *end = rec + len;
+    const char *p = rec;
+    const char *q;
+
+    while (true) {
+        if (p < end && *p == '"') {
+            // Quoted field: skip to the closing quote, past any "".
+            q = p + 1;
+            while (q < end) {
+                q = memchr(q, '"', end - q);
+                if (q == NULL) {
+                    q = end;
+                    break;
+                }
+                ++q;
+                if (q < end && *q == '"') {
+                    ++q;
+                    continue;
+                }
+                break;
+            }
+            // Anything between the closing quote and |sep| is
+            // kept as part of the field.
+            q = memchr(q, sep, end - q);
+        }
+        else {
+            q = memchr(p, sep, end - p);
+        }
+        if (q == NULL) {
+            q = end;
+        }
+        if (--n == 0) {
+            *beg_ref = p - rec;
+            *end_ref = q - rec;
+            return (0);
+        }
+        if (q == end) {
+            return (ENOENT);
+        }
+        p = q + 1;
+    }
+}
 
-    linebuf_t *lbuf;
+/*
+ * Hyphenate field |opt_field| of one record, in place,
+ * and print the whole record.  The bytes around the field
+ * are written as they are, as slices of the input record.
+ * If the field (after removing quotes) is not a valid ISBN-13,
+ * or the lookup fails, the record is printed unchanged.
+ * With --annotate, a status code is added, as a last field.
+ */
+static void
+field_one(const char *rec, size_t len)
+{
+    char isbn_str[14];
     char hbuf[32];
+    size_t beg, end;
+    size_t prefix_nr = UNDEF_INDEX;
+    uint64_t t0 = 0, t1 = 0;
     int rv;
 
-    lbuf = linebuf_new();
-    linebuf_init(lbuf, f);
+    if (opt_stats) {
+        ++stats->lines;
+        stats->bytes_in += len + 1;
+    }
+
+    rv = find_field(rec, len, opt_field, opt_separator, &beg, &end);
+    if (rv == 0) {
+        if (end - beg >= 2 && rec[beg] == '"' && rec[end - 1] == '"') {
+            ++beg;
+            --end;
+        }
+        rv = isbn_validate(rec + beg, end - beg);
+    }
+    else {
+        // A missing field is as good as an empty one.
+        beg = end = len;
+        rv = EINVAL;
+    }
+
+    if (rv == 0) {
+        memcpy(isbn_str, rec + beg, 13);
+        isbn_str[13] = '\0';
+        if (opt_stats) {
+            t0 = now_ns();
+        }
+        rv = hyphenate_isbn_ex(isbn_info, hbuf, sizeof (hbuf), isbn_str,
+            &prefix_nr);
+        if (opt_stats) {
+            stats->ns_lookup += now_ns() - t0;
+        }
+    }
+    if (opt_stats) {
+        isbn_stats_count(stats, rv, prefix_nr);
+    }
+
+    if (opt_stats) {
+        t1 = now_ns();
+    }
+    if (rv == 0) {
+        fwrite(rec, 1, beg, out);
+        fputs(hbuf, out);
+        fwrite(rec + end, 1, len - end, out);
+        len += strlen(hbuf) - 13;
+    }
+    else {
+        fwrite(rec, 1, len, out);
+    }
+    if (opt_annotate) {
+        len += fprintf(out, "%c%s", opt_separator, isbn_status_code(rv));
+    }
+    fputc(opt_delim, out);
+    if (opt_stats) {
+        stats->bytes_out += len + 1;
+        stats->ns_output += now_ns() - t1;
+        signals_poll();
+    }
+}
+
+// ################ input
+
+/*
+ * Handle one input record.  Empty records are counted, but skipped,
+ * unless --annotate was given.
+ */
+static inline void
+isbn_record(const char *rec, size_t len, isbn_lat_t *lat)
+{
+    if (opt_field != 0) {
+        field_one(rec, len);
+        return;
+    }
+    if (len == 0 && !opt_annotate) {
+        if (opt_stats) {
+            ++stats->lines;
+            ++stats->bytes_in;
+        }
+        return;
+    }
+    if (debug) {
+        dbg_show_var("line", rec);
+    }
+    hyphenate_one(rec, len, lat);
+}
+
+/*
+ * Read records of text, ended by the --delimiter byte, and handle each.
+ * Input is read a block at a time, with zin_read(), into one buffer
+ * that is reused for the whole stream; each record is handled
+ * in place, and only a record that straddles two reads is moved.
+ * See recbuf.h.  This works the same for pipes as for files.
+ */
+static void
+eprint_read_err(const char *fname, int err, const zin_t *zin)
+{
+    if (err == EBADMSG && zin_codec(zin) != ZS_NONE) {
+        eprintf("'%s': corrupt or truncated %s data\n", fname,
+            zs_codec_name(zin_codec(zin)));
+        return;
+    }
+    eprintf("read('%s') failed, errno=%d\n", fname, err);
+}
+
+/*
+ * --coprocess: read more input, but first, if none is waiting,
+ * send every answer so far.
+ *
+ * This is called only once all the records already read have been
+ * handled, so the other end, if it has stopped writing, is waiting
+ * for those answers; holding them back, for a full buffer, would
+ * deadlock a program that writes one request and reads one answer.
+ * When more input is already there, it is read without flushing,
+ * and answers go out a buffer at a time, as usual.
+ */
+static ssize_t
+coprocess_read(void *zin, void *buf, size_t n)
+{
+    struct pollfd pfd;
+
+    pfd.fd = coprocess_fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) == 0) {
+        binout_flush();
+        fflush(out);
+    }
+    return (zin_read(zin, buf, n));
+}
+
+static int
+isbn_stream_text(const char *fname, zin_t *zin)
+{
+    recbuf_t *rb;
+    isbn_lat_t *lat;
+    uint64_t t0 = 0;
+    uint64_t t = 0;
+    char *rec;
+    size_t len;
+    int err;
+
+    rb = recbuf_new(-1, 0);
+    recbuf_set_reader(rb, opt_coprocess ? coprocess_read : zin_read, zin);
     while (true) {
-        fgetline(lbuf);
-        if (lbuf->eof) {
+        if (opt_stats) {
+            t0 = now_ns();
+        }
+        lat = isbn_lat_sample(ISBN_LAT_SITE_IO, &t);
+        rec = recbuf_getrec(rb, opt_delim, &len);
+        isbn_lat_phase(lat, ISBN_LAT_READ, &t);
+        if (opt_stats) {
+            stats->ns_parse += now_ns() - t0;
+        }
+        if (rec == NULL) {
             break;
         }
-        if (lbuf->len == 0) {
-            continue;
+        isbn_record(rec, len, lat);
+    }
+    err = rb->err;
+    recbuf_free(rb);
+    if (err) {
+        eprint_read_err(fname, err, zin);
+    }
+    return (err);
+}
+
+/*
+ * Expand one record of --input=packed to text, as it is;
+ * no lookup is needed.  A record that does not hold hyphen
+ * positions is counted, as a bad record, and skipped.
+ */
+static inline void
+packed_record(uint64_t packed)
+{
+    char hbuf[32];
+    uint64_t t0 = 0;
+    int rv;
+
+    rv = isbn_unpack(packed, hbuf, sizeof (hbuf));
+    if (opt_stats) {
+        ++stats->lines;
+        stats->bytes_in += sizeof (packed);
+        isbn_stats_count(stats, rv, UNDEF_INDEX);
+        t0 = now_ns();
+    }
+    if (rv == 0) {
+        print_rec(hbuf);
+        if (opt_stats) {
+            stats->bytes_out += strlen(hbuf) + 1;
+            stats->ns_output += now_ns() - t0;
         }
+    }
+}
 
-        dbg_show_var("line=[%s]", lbuf->buf);
+/*
+ * Handle one fixed-width binary input record.
+ * Unless the output is binary, too, it is converted to text,
+ * and handled just as if it had been read as text.
+ */
+static inline void
+bin_record(const char *rec)
+{
+    char digits[24];
+    uint64_t isbn13;
+    int rv;
 
-        rv = hyphenate_isbn(isbn_info, hbuf, sizeof (hbuf), lbuf->buf);
-        if (rv == 0) {
-            printl(hbuf);
+    if (opt_input == IN_ISBN13) {
+        if (out_is_bin()) {
+            rv = isbn_from_str(rec, 13, &isbn13);
+            bin_one(isbn13, rv, 13);
+            return;
         }
+        memcpy(digits, rec, 13);
+        digits[13] = '\0';
+        isbn_record(digits, 13, NULL);
+        return;
     }
-    linebuf_free(lbuf);
-    free(lbuf);
 
-    return (0);
+    memcpy(&isbn13, rec, sizeof (isbn13));
+    if (opt_input == IN_PACKED) {
+        if (opt_format == FMT_TEXT && !opt_annotate) {
+            packed_record(isbn13);
+            return;
+        }
+        // Anything more than the hyphens takes a lookup.
+        isbn13 = isbn_packed_isbn13(isbn13);
+    }
+
+    if (out_is_bin()) {
+        rv = opt_annotate ? isbn_validate_u64(isbn13) : 0;
+        bin_one(isbn13, rv, sizeof (isbn13));
+        return;
+    }
+    if (isbn13 >= 10000000000000ULL && !opt_annotate) {
+        // Too many digits; count it as a bad record, and skip it.
+        if (opt_stats) {
+            ++stats->lines;
+            stats->bytes_in += sizeof (isbn13);
+            isbn_stats_count(stats, EINVAL, UNDEF_INDEX);
+        }
+        return;
+    }
+    rv = snprintf(digits, sizeof (digits), "%013" PRIu64, isbn13);
+    isbn_record(digits, rv, NULL);
+}
+
+/*
+ * Same as isbn_stream(), but for fixed-width binary records;
+ * see --input.  Input is read a block at a time, with zin_read(),
+ * and records are taken from the block where they lie.  Only
+ * a record that straddles two reads is moved, to the start
+ * of the block.
+ */
+static int
+isbn_stream_bin(const char *fname, zin_t *zin)
+{
+    size_t recsz;
+    size_t bsz;
+    size_t have;
+    size_t used;
+    uint64_t t0 = 0;
+    ssize_t n;
+    char *buf;
+    int err;
+
+    recsz = opt_input == IN_ISBN13 ? 13 : sizeof (uint64_t);
+    bsz = BIN_BLOCK_SIZE - BIN_BLOCK_SIZE % recsz;
+    buf = (char *)guard_malloc(bsz);
+    have = 0;
+    err = 0;
+    while (true) {
+        if (opt_stats) {
+            t0 = now_ns();
+        }
+        if (opt_coprocess) {
+            n = coprocess_read(zin, buf + have, bsz - have);
+        }
+        else {
+            n = zin_read(zin, buf + have, bsz - have);
+        }
+        if (opt_stats) {
+            stats->ns_parse += now_ns() - t0;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            err = errno;
+            eprint_read_err(fname, err, zin);
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        have += n;
+        for (used = 0; used + recsz <= have; used += recsz) {
+            bin_record(buf + used);
+        }
+        // Keep any partial record for the next read.
+        memmove(buf, buf + used, have - used);
+        have -= used;
+        if (opt_stats || lat_hists != NULL) {
+            signals_poll();
+        }
+    }
+    free(buf);
+    if (err == 0 && have != 0) {
+        eprintf("'%s': %zu bytes at the end are not a whole record\n",
+            fname, have);
+        err = EINVAL;
+    }
+    return (err);
+}
+
+/*
+ * With --decompress=auto, u64 and packed input are taken as they
+ * are; any 8 bytes are a record, even some that look like a header.
+ * A coprocess gets plain requests, which are never held up
+ * by a decoder working a block ahead.
+ */
+static zs_codec_t
+input_codec(void)
+{
+    if (opt_coprocess) {
+        return (ZS_NONE);
+    }
+    if (opt_decompress == ZS_AUTO
+        && (opt_input == IN_U64 || opt_input == IN_PACKED)) {
+        return (ZS_NONE);
+    }
+    return (opt_decompress);
+}
+
+int
+isbn_stream(const char *fname, FILE *f)
+{
+    zin_t *zin;
+    int rv;
+
+    coprocess_fd = fileno(f);
+    rv = zin_open(&zin, fileno(f), input_codec());
+    if (rv == ENOTSUP) {
+        eprintf("'%s': zstd input, but built without zstd;"
+            " see ZSTD=1 in build.mk\n", fname);
+        return (rv);
+    }
+    if (rv != 0) {
+        eprintf("read('%s') failed, errno=%d\n", fname, rv);
+        return (rv);
+    }
+    if (verbose && zin_codec(zin) != ZS_NONE) {
+        eprintf("'%s': %s\n", fname, zs_codec_name(zin_codec(zin)));
+    }
+
+    if (opt_input != IN_TEXT) {
+        rv = isbn_stream_bin(fname, zin);
+    }
+    else {
+        rv = isbn_stream_text(fname, zin);
+    }
+    zin_close(zin);
+    return (rv);
+}
+
+/*
+ * Append |n| bytes to the record that was cut off at the end
+ * of the last block, keeping room for a NUL.
+ */
+static void
+tail_append(char **tail_ref, size_t *len_ref, size_t *size_ref,
+    const char *buf, size_t n)
+{
+    if (*len_ref + n + 1 > *size_ref) {
+        *size_ref = 2 * (*len_ref + n + 1);
+        *tail_ref = (char *)guard_realloc(*tail_ref, *size_ref);
+    }
+    memcpy(*tail_ref + *len_ref, buf, n);
+    *len_ref += n;
+}
+
+/*
+ * Same as filev_isbn(), but with reads kept in flight ahead of
+ * the lookups, possibly across files; see aread.h.
+ *
+ * Records are handled in place, in the block they were read into.
+ * Only a record that straddles two blocks is copied, to |tail|.
+ * A record never runs from one file into the next.
+ */
+static int
+filev_isbn_aread(void)
+{
+    aread_t *ar;
+    aread_block_t blk;
+    char *tail = NULL;
+    size_t tail_len = 0;
+    size_t tail_size = 0;
+    uint64_t t0 = 0;
+    size_t fnr = filec;
+    char *p;
+    char *q;
+    char *end;
+    int err;
+    int rv;
+
+    ar = aread_new(filec, filev, (unsigned int)opt_readahead, 0, 0);
+    if (verbose) {
+        eprintf("readahead: %zu in flight, %s\n", opt_readahead,
+            aread_async(ar) ? "io_uring" : "pread");
+    }
+    err = 0;
+    while (true) {
+        if (opt_stats) {
+            t0 = now_ns();
+        }
+        rv = aread_next(ar, &blk);
+        if (opt_stats) {
+            stats->ns_parse += now_ns() - t0;
+        }
+        if (rv != 0) {
+            break;
+        }
+        if (blk.err) {
+            err = blk.err;
+            eprintf("read('%s') failed, errno=%d\n", filev[blk.fnr], err);
+            break;
+        }
+        if (blk.fnr != fnr) {
+            fnr = blk.fnr;
+            if (opt_decompress != ZS_NONE
+                && zs_sniff(blk.buf, blk.len) != ZS_NONE) {
+                err = EINVAL;
+                eprintf("'%s': compressed; --readahead reads only"
+                    " plain files\n", filev[fnr]);
+                break;
+            }
+        }
+
+        p = blk.buf;
+        end = p + blk.len;
+        if (tail_len != 0) {
+            q = (char *)memchr(p, opt_delim, end - p);
+            tail_append(&tail, &tail_len, &tail_size, p, (q ? q : end) - p);
+            if (q != NULL) {
+                tail[tail_len] = '\0';
+                isbn_record(tail, tail_len, NULL);
+                tail_len = 0;
+                p = q + 1;
+            }
+            else {
+                p = end;
+            }
+        }
+        while (p < end) {
+            q = (char *)memchr(p, opt_delim, end - p);
+            if (q == NULL) {
+                tail_append(&tail, &tail_len, &tail_size, p, end - p);
+                break;
+            }
+            *q = '\0';
+            isbn_record(p, q - p, NULL);
+            p = q + 1;
+        }
+        if (blk.last && tail_len != 0) {
+            tail[tail_len] = '\0';
+            isbn_record(tail, tail_len, NULL);
+            tail_len = 0;
+        }
+        if (opt_stats || lat_hists != NULL) {
+            signals_poll();
+        }
+    }
+    aread_free(ar);
+    free(tail);
+    return (err);
 }
 
 int
@@ -270,14 +1490,14 @@ filev_isbn(void)
 int
 argv_isbn(size_t argc, char **argv)
 {
-    char hbuf[32];
     size_t i;
-    int rv;
 
     for (i = 0; i < argc; ++i) {
-        rv = hyphenate_isbn(isbn_info, hbuf, sizeof (hbuf), argv[i]);
-        if (rv == 0) {
-            printl(hbuf);
+        if (opt_field != 0) {
+            field_one(argv[i], strlen(argv[i]));
+        }
+        else {
+            hyphenate_one(argv[i], strlen(argv[i]), NULL);
         }
     }
 
@@ -292,9 +1512,11 @@ main(int argc, char **argv)
     int option_index;
     int err_count;
     int optc;
+    int err;
     int rv;
 
     set_eprint_fh();
+    out = stdout;
     program_path = *argv;
     program_name = sname(program_path);
     option_index = 0;
@@ -310,7 +1532,7 @@ main(int argc, char **argv)
         }
 
         this_option_optind = optind ? optind : 1;
-        optc = getopt_long(argc, argv, "+hVdvEHw:", long_options, &option_index);
+        optc = getopt_long(argc, argv, "+hVdvEHw:z", long_options, &option_index);
         if (optc == -1) {
             break;
         }
@@ -331,7 +1553,7 @@ main(int argc, char **argv)
             break;
         case 'd':
             debug = true;
-            set_debug_fh(NULL);
+            set_debug_fh("");
             break;
         case 'v':
             verbose = true;
@@ -339,6 +1561,153 @@ main(int argc, char **argv)
         case 'A':
             opt_argv = true;
             break;
+        case 'S':
+            opt_stats = true;
+            if (optarg == NULL || strcmp(optarg, "text") == 0) {
+                opt_stats_json = false;
+            }
+            else if (strcmp(optarg, "json") == 0) {
+                opt_stats_json = true;
+            }
+            else {
+                eprintf("%s: --stats=%s: expected text or json\n",
+                    program_name, optarg);
+                ++err_count;
+            }
+            break;
+        case 'M':
+            opt_mem_report = true;
+            break;
+        case 'P':
+            opt_protect_tables = true;
+            break;
+        case 'a':
+            opt_annotate = true;
+            break;
+        case 'z':
+            opt_delim = '\0';
+            break;
+        case 'D':
+            rv = parse_delimiter(optarg);
+            if (rv < 0) {
+                eprintf("%s: --delimiter=%s: expected one byte,"
+                    " or \\0, \\t, \\n, \\r\n", program_name, optarg);
+                ++err_count;
+            }
+            else {
+                opt_delim = rv;
+            }
+            break;
+        case 'f':
+            rv = parse_cardinal(&opt_field, optarg);
+            if (rv != 0 || opt_field == 0) {
+                eprintf("%s: --field=%s: expected a field number,"
+                    " from 1\n", program_name, optarg);
+                ++err_count;
+            }
+            break;
+        case 's':
+            rv = parse_delimiter(optarg);
+            if (rv < 0 || rv == '"') {
+                eprintf("%s: --separator=%s: expected one byte,"
+                    " or \\0, \\t, \\n, \\r\n", program_name, optarg);
+                ++err_count;
+            }
+            else {
+                opt_separator = rv;
+            }
+            break;
+        case 'F':
+            if (strcmp(optarg, "text") == 0) {
+                opt_format = FMT_TEXT;
+            }
+            else if (strcmp(optarg, "tsv") == 0) {
+                opt_format = FMT_TSV;
+            }
+            else if (strcmp(optarg, "json") == 0) {
+                opt_format = FMT_JSON;
+            }
+            else if (strcmp(optarg, "bin") == 0) {
+                opt_format = FMT_BIN;
+            }
+            else if (strcmp(optarg, "packed") == 0) {
+                opt_format = FMT_PACKED;
+            }
+            else {
+                eprintf("%s: --format=%s: expected text, tsv, json,"
+                    " bin, or packed\n", program_name, optarg);
+                ++err_count;
+            }
+            break;
+        case 'I':
+            if (strcmp(optarg, "text") == 0) {
+                opt_input = IN_TEXT;
+            }
+            else if (strcmp(optarg, "u64") == 0) {
+                opt_input = IN_U64;
+            }
+            else if (strcmp(optarg, "isbn13") == 0) {
+                opt_input = IN_ISBN13;
+            }
+            else if (strcmp(optarg, "packed") == 0) {
+                opt_input = IN_PACKED;
+            }
+            else {
+                eprintf("%s: --input=%s: expected text, u64, isbn13,"
+                    " or packed\n", program_name, optarg);
+                ++err_count;
+            }
+            break;
+        case 'R':
+            opt_readahead = AREAD_DEPTH_DEFAULT;
+            if (optarg != NULL) {
+                rv = parse_cardinal(&opt_readahead, optarg);
+                if (rv != 0 || opt_readahead == 0 || opt_readahead > 1024) {
+                    eprintf("%s: --readahead=%s: expected 1 to 1024\n",
+                        program_name, optarg);
+                    ++err_count;
+                }
+            }
+            break;
+        case 'U':
+            rv = parse_codec(optarg, &opt_decompress);
+            if (rv != 0) {
+                eprintf("%s: --decompress=%s: expected auto, gzip, zstd,"
+                    " or none\n", program_name, optarg);
+                ++err_count;
+            }
+            break;
+        case 'C':
+            rv = parse_compress(optarg);
+            if (rv != 0) {
+                eprintf("%s: --compress=%s: expected gzip or zstd,"
+                    " then optionally :LEVEL\n", program_name, optarg);
+                ++err_count;
+            }
+            break;
+        case 'T':
+            rv = parse_cardinal(&opt_codec_threads, optarg);
+            if (rv != 0 || opt_codec_threads == 0
+                || opt_codec_threads > 64) {
+                eprintf("%s: --codec-threads=%s: expected 1 to 64\n",
+                    program_name, optarg);
+                ++err_count;
+            }
+            break;
+        case 'c':
+            opt_coprocess = true;
+            break;
+        case 'L':
+            opt_lat_every = 64;
+            if (optarg != NULL) {
+                rv = parse_cardinal(&opt_lat_every, optarg);
+                if (rv != 0 || opt_lat_every == 0) {
+                    eprintf("%s: --latency=%s: expected a count,"
+                        " from 1\n", program_name, optarg);
+                    ++err_count;
+                }
+            }
+            break;
         case '?':
             eprint(program_name);
             eprint(": ");
@@ -385,14 +1754,64 @@ main(int argc, char **argv)
         }
     }
 
+    if (opt_field != 0 && (opt_format != FMT_TEXT || opt_input != IN_TEXT)) {
+        eprintf("%s: --field works only with --format=text,"
+            " and --input=text\n", program_name);
+        ++err_count;
+    }
+
+    if (opt_argv && opt_input != IN_TEXT) {
+        eprintf("%s: --argv works only with --input=text\n", program_name);
+        ++err_count;
+    }
+
+    if (opt_coprocess && (opt_compress != ZS_NONE
+        || (opt_decompress != ZS_AUTO && opt_decompress != ZS_NONE)
+        || opt_argv || opt_readahead != 0)) {
+        eprintf("%s: --coprocess does not go with --compress, --decompress,"
+            " --argv, or --readahead\n", program_name);
+        ++err_count;
+    }
+
+    if (!zs_codec_available(opt_decompress)
+        || !zs_codec_available(opt_compress)) {
+        eprintf("%s: zstd: built without zstd; see ZSTD=1 in build.mk\n",
+            program_name);
+        ++err_count;
+    }
+
     if (err_count != 0) {
         usage();
         exit(1);
     }
 
-    isbn_info = (void *)parse_isbn_range_table("isbn-range.xml");
-    if (rv != 0) {
-        exit(rv);
+    isbn_info = parse_isbn_range_table_ex("isbn-range.xml",
+        opt_protect_tables ? ISBN_FINALIZE_PROTECT : 0);
+    if (isbn_info == NULL) {
+        exit(2);
+    }
+
+    if (opt_mem_report) {
+        isbn_mem_t mem;
+
+        isbn_mem_usage(isbn_info, &mem);
+        fprint_isbn_mem(stderr, &mem);
+    }
+
+    if (opt_stats || opt_lat_every != 0) {
+        report_start();
+    }
+
+    if (opt_coprocess) {
+        // Batches can be big; flushes, not the buffer size, bound latency.
+        setvbuf(out, NULL, _IOFBF, BIN_BLOCK_SIZE);
+    }
+
+    if (opt_compress != ZS_NONE) {
+        rv = compress_start();
+        if (rv != 0) {
+            exit(rv);
+        }
     }
 
     if (opt_argv) {
@@ -401,6 +1820,9 @@ main(int argc, char **argv)
     else if (filec == 0) {
         rv = isbn_stream("-", stdin);
     }
+    else if (opt_readahead != 0 && opt_input == IN_TEXT) {
+        rv = filev_isbn_aread();
+    }
     else {
         rv = filev_probe(filec, filev);
         if (rv != 0) {
@@ -410,6 +1832,27 @@ main(int argc, char **argv)
         rv = filev_isbn();
     }
 
+    binout_flush();
+    if (zout != NULL) {
+        // Close it even after an error, to join the codec threads;
+        // keep the first error.
+        err = compress_finish();
+        if (binout_err == 0) {
+            binout_err = err;
+        }
+    }
+    if (binout_err != 0) {
+        eprintf("write(stdout) failed, errno=%d\n", binout_err);
+        if (rv == 0) {
+            rv = binout_err;
+        }
+    }
+
+    if (opt_stats || opt_lat_every != 0) {
+        fflush(out);
+        report();
+    }
+
     if (rv != 0) {
         exit(rv);
     }
@@ -0,0 +1,46 @@
+#!/bin/bash
+#
+# Filename: src/cmd/test/coprocess.sh
+# Project: isbn-hyphenate
+# Brief: Drive isbn-hyphenate --coprocess over pipes, one request at a time
+#
+# Copyright (C) 2016-2020 Guy Shaw
+# Written by Guy Shaw <gshaw@acm.org>
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as
+# published by the Free Software Foundation; either version 3 of the
+# License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Usage: coprocess.sh <input> [ <isbn-hyphenate options> ]
+#
+# Write one request, then wait for its answer before writing the next,
+# the way a client in another language would.  If answers are held
+# back in a buffer, the read times out, and this fails, instead of
+# hanging.  Run it from the directory that has isbn-range.xml.
+
+input="$1"
+shift
+
+coproc ISBN { ./isbn-hyphenate "$@" ; }
+
+while IFS= read -r request ; do
+    printf '%s\n' "${request}" >&"${ISBN[1]}"
+    if ! IFS= read -r -t 5 answer <&"${ISBN[0]}" ; then
+        echo "coprocess.sh: no answer to '${request}' within 5 seconds" >&2
+        kill "${ISBN_PID}"
+        exit 1
+    fi
+    printf '%s\n' "${answer}"
+done < "${input}"
+
+exec {ISBN[1]}>&-
+wait "${ISBN_PID}"
@@ -0,0 +1,336 @@
+/*
+ * Filename: src/gen-corpus/isbn-gen-corpus.c
+ * Project: isbn-hyphenate
+ * Brief: Generate a synthetic corpus of ISBN-13s from the range table
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <errno.h>
+    // Import var EINVAL
+    // Import var EIO
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stddef.h>
+    // Import constant NULL
+#include <stdint.h>
+    // Import type uint64_t
+#include <stdio.h>
+    // Import type FILE
+    // Import fflush()
+    // Import ferror()
+    // Import fputs()
+    // Import fwrite()
+    // Import var stdout
+#include <stdlib.h>
+    // Import exit()
+    // Import strtod()
+    // Import strtoull()
+#include <string.h>
+    // Import strcmp()
+#include <unistd.h>
+    // Import getopt_long()
+    // Import optarg()
+    // Import opterr()
+    // Import optind()
+    // Import optopt()
+    // Import type size_t
+
+#include <cscript.h>
+#include <fprint.h>
+#include <isbn-corpus.h>
+#include <isbn-info.h>
+
+const char *program_path;
+const char *program_name;
+
+FILE *eprint_fh = NULL;
+FILE *dprint_fh = NULL;
+
+bool verbose  = false;
+bool debug    = false;
+
+enum out_format {
+    OUT_TEXT,       // One ISBN-13 per line
+    OUT_NUL,        // NUL-terminated ISBN-13s
+    OUT_U64,        // uint64_t, native byte order
+};
+
+static const char *opt_xml = "isbn-range.xml";
+static size_t opt_count = 1000000;
+static enum out_format opt_format = OUT_TEXT;
+static isbn_corpus_opts_t gen_opts = { ISBN_DIST_WEIGHTED, 0.0, 0.0, 0.0, 0 };
+
+static struct option long_options[] = {
+    {"help",       no_argument,       0, 'h'},
+    {"version",    no_argument,       0, 'V'},
+    {"verbose",    no_argument,       0, 'v'},
+    {"debug",      no_argument,       0, 'd'},
+    {"xml",        required_argument, 0, 'x'},
+    {"count",      required_argument, 0, 'n'},
+    {"seed",       required_argument, 0, 's'},
+    {"uniform",    no_argument,       0, 'U'},
+    {"weighted",   no_argument,       0, 'W'},
+    {"invalid",    required_argument, 0, 'I'},
+    {"unassigned", required_argument, 0, 'N'},
+    {"duplicates", required_argument, 0, 'D'},
+    {"format",     required_argument, 0, 'f'},
+    {"null",       no_argument,       0, '0'},
+    {0, 0, 0, 0}
+};
+
+static const char usage_text[] =
+    "Options:\n"
+    "  --help|-h|-?         Show this help message and exit\n"
+    "  --version            Show version information and exit\n"
+    "  --verbose|-v         verbose\n"
+    "  --debug|-d           debug\n"
+    "  --xml|-x <file>      Range table (default isbn-range.xml)\n"
+    "  --count|-n <n>       How many ISBN-13s (default 1000000)\n"
+    "  --seed|-s <n>        Random seed; same seed, same corpus\n"
+    "  --uniform            All registration groups equally likely\n"
+    "  --weighted           Groups weighted like real traffic (default)\n"
+    "  --invalid <frac>     Fraction with a wrong check digit\n"
+    "  --unassigned <frac>  Fraction in unassigned ranges\n"
+    "  --duplicates <frac>  Fraction that repeat an earlier ISBN-13\n"
+    "  --format <fmt>       text (default), nul, or u64\n"
+    "  --null|-0            Same as --format=nul\n"
+    ;
+
+static const char version_text[] =
+    "0.1\n"
+    ;
+
+static const char copyright_text[] =
+    "Copyright (C) 2016-2020 Guy Shaw\n"
+    "Written by Guy Shaw\n"
+    ;
+
+static const char license_text[] =
+    "License GPLv3+: GNU GPL version 3 or later"
+    " <http://gnu.org/licenses/gpl.html>.\n"
+    "This is free software: you are free to change and redistribute it.\n"
+    "There is NO WARRANTY, to the extent permitted by law.\n"
+    ;
+
+static void
+show_program_version(void)
+{
+    fprintl(stdout, version_text);
+    fprintl(stdout, copyright_text);
+    fprintl(stdout, license_text);
+}
+
+static void
+usage(void)
+{
+    eprint("usage: ");
+    eprint(program_name);
+    eprintl(" [ <options> ]");
+    eprint(usage_text);
+}
+
+static int
+parse_fraction(double *r, const char *str)
+{
+    char *end = NULL;
+    double d;
+
+    d = strtod(str, &end);
+    if (!(end > str && *end == '\0') || d < 0.0 || d > 1.0) {
+        eprintf("%s: Invalid fraction, '%s'.\n", program_name, str);
+        return (EINVAL);
+    }
+    *r = d;
+    return (0);
+}
+
+static int
+parse_format(const char *str)
+{
+    if (strcmp(str, "text") == 0) {
+        opt_format = OUT_TEXT;
+    }
+    else if (strcmp(str, "nul") == 0) {
+        opt_format = OUT_NUL;
+    }
+    else if (strcmp(str, "u64") == 0) {
+        opt_format = OUT_U64;
+    }
+    else {
+        eprintf("%s: Unknown format, '%s'.\n", program_name, str);
+        return (EINVAL);
+    }
+    return (0);
+}
+
+static int
+gen_corpus(isbn_corpus_t *gen, FILE *f)
+{
+    char buf[16];
+    uint64_t isbn13;
+    size_t i;
+
+    for (i = 0; i < opt_count; ++i) {
+        switch (opt_format) {
+        case OUT_TEXT:
+            isbn_corpus_next(gen, buf);
+            buf[13] = '\n';
+            fwrite(buf, 1, 14, f);
+            break;
+        case OUT_NUL:
+            isbn_corpus_next(gen, buf);
+            fwrite(buf, 1, 14, f);
+            break;
+        case OUT_U64:
+            isbn_corpus_next_u64(gen, &isbn13);
+            fwrite(&isbn13, sizeof (isbn13), 1, f);
+            break;
+        }
+    }
+    if (fflush(f) != 0 || ferror(f)) {
+        eprintf("%s: Write error.\n", program_name);
+        return (EIO);
+    }
+    return (0);
+}
+
+int
+main(int argc, char **argv)
+{
+    extern char *optarg;
+    extern int optind, opterr, optopt;
+    isbn_info_t *isbn_info;
+    isbn_corpus_t *gen;
+    int option_index;
+    int err_count;
+    int optc;
+    int rv;
+
+    set_eprint_fh();
+    program_path = *argv;
+    program_name = sname(program_path);
+    option_index = 0;
+    err_count = 0;
+    opterr = 0;
+
+    while (true) {
+        optc = getopt_long(argc, argv, "+hVdvx:n:s:0", long_options, &option_index);
+        if (optc == -1) {
+            break;
+        }
+
+        rv = 0;
+        if (optc == '?' && optopt == '?') {
+            optc = 'h';
+        }
+
+        switch (optc) {
+        case 'V':
+            show_program_version();
+            exit(0);
+            break;
+        case 'h':
+            fputs(usage_text, stdout);
+            exit(0);
+            break;
+        case 'd':
+            debug = true;
+            set_debug_fh("");
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        case 'x':
+            opt_xml = optarg;
+            break;
+        case 'n':
+            rv = parse_cardinal(&opt_count, optarg);
+            break;
+        case 's':
+            gen_opts.seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'U':
+            gen_opts.dist = ISBN_DIST_UNIFORM;
+            break;
+        case 'W':
+            gen_opts.dist = ISBN_DIST_WEIGHTED;
+            break;
+        case 'I':
+            rv = parse_fraction(&gen_opts.invalid, optarg);
+            break;
+        case 'N':
+            rv = parse_fraction(&gen_opts.unassigned, optarg);
+            break;
+        case 'D':
+            rv = parse_fraction(&gen_opts.duplicate, optarg);
+            break;
+        case 'f':
+            rv = parse_format(optarg);
+            break;
+        case '0':
+            opt_format = OUT_NUL;
+            break;
+        case '?':
+            eprintf("%s: unknown option, '%s'\n",
+                program_name, argv[optind - 1]);
+            ++err_count;
+            break;
+        default:
+            eprintf("%s: INTERNAL ERROR: unknown option, '%c'\n",
+                program_name, optopt);
+            exit(2);
+            break;
+        }
+        if (rv != 0) {
+            ++err_count;
+        }
+    }
+
+    verbose = verbose || debug;
+
+    if (gen_opts.invalid + gen_opts.unassigned + gen_opts.duplicate > 1.0) {
+        eprintf("%s: Fractions add up to more than 1.\n", program_name);
+        ++err_count;
+    }
+
+    if (optind < argc) {
+        eprintf("%s: Unexpected argument, '%s'.\n", program_name, argv[optind]);
+        ++err_count;
+    }
+
+    if (err_count != 0) {
+        usage();
+        exit(1);
+    }
+
+    isbn_info = parse_isbn_range_table(opt_xml);
+    if (isbn_info == NULL) {
+        exit(2);
+    }
+
+    gen = isbn_corpus_new(isbn_info, &gen_opts);
+    rv = gen_corpus(gen, stdout);
+    isbn_corpus_free(gen);
+    exit(rv ? 1 : 0);
+}
@@ -0,0 +1,83 @@
+/*
+ * Filename: src/inc/aread.h
+ * Project: libcscript
+ * Brief: Read a list of files in order, with several reads in flight
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _AREAD_H
+#define _AREAD_H
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+    // Import type bool
+#include <unistd.h>
+    // Import type size_t
+
+/*
+ * A sequential reader over a list of files, that keeps up to |depth|
+ * block-sized reads in flight, ahead of the caller, possibly across
+ * several of the upcoming files.  Blocks are handed back strictly
+ * in order: all of file 0, then all of file 1, and so on.
+ *
+ * On Linux, reads are queued with io_uring, set up with raw system
+ * calls, so no extra library is needed.  Where io_uring is missing,
+ * or not allowed, or if AREAD_SYNC is given, each read is done with
+ * pread(2) when its block is wanted, and the reads still to come
+ * are announced ahead of time with posix_fadvise(POSIX_FADV_WILLNEED),
+ * so that the kernel can overlap them with the caller's work.
+ *
+ * Files are opened only as the reader gets to them; a file that
+ * cannot be opened shows up as a block with |err| set.
+ * The filename "-" means standard input.  Pipes, terminals, and
+ * other files that cannot be read at an offset are read one block
+ * at a time, in order.
+ */
+
+struct aread_block {
+    char   *buf;        // Data; the caller may modify it
+    size_t len;
+    size_t fnr;         // Index of the file it came from
+    int    err;         // errno, from open() or read(), or 0
+    bool   last;        // No more blocks will come from file |fnr|
+};
+
+typedef struct aread_block aread_block_t;
+
+struct aread;
+typedef struct aread aread_t;
+
+#define AREAD_SYNC          0x0001  // Do not try io_uring
+
+#define AREAD_DEPTH_DEFAULT 8
+#define AREAD_BSIZE_DEFAULT (256 * 1024)
+
+extern aread_t *aread_new(size_t filec, char **filev, unsigned int depth,
+    size_t bsize, unsigned int flags);
+extern int aread_next(aread_t *ar, aread_block_t *blk);
+extern bool aread_async(const aread_t *ar);
+extern void aread_free(aread_t *ar);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif  /* _AREAD_H */
@@ -125,6 +125,7 @@ extern size_t fshow_strn(FILE *, const char *, size_t);
 extern size_t show_char_r(char *buf, size_t sz, int chr);
 extern void   fshow_errno(FILE *f, const char *msg, int err);
 extern void   fshow_fname(FILE *f, const char *fname);
+extern size_t fputs_json(FILE *f, const char *s);
 extern void   fshow_wait_status(FILE *, const char *, int);
 extern const char * sname(const char *);
 extern char * decode_esym_r(char *buf, size_t sz, int err);
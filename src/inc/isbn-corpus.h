@@ -0,0 +1,99 @@
+/*
+ * Filename: src/inc/isbn-corpus.h
+ * Project: isbn-hyphenate
+ * Brief: Generate synthetic ISBN-13s from the range table
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ISBN_CORPUS_H
+#define _ISBN_CORPUS_H
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+    // Import type uint64_t
+#include <unistd.h>
+    // Import type size_t
+
+#include <isbn-info.h>
+
+/*
+ * How to choose a registration group for each ISBN.
+ *
+ * ISBN_DIST_UNIFORM:
+ *     Every prefix that has at least one assigned range
+ *     is equally likely.
+ *
+ * ISBN_DIST_WEIGHTED:
+ *     Roughly the mix seen in real traffic,
+ *     where 978-0 and 978-1 dominate.
+ */
+
+enum isbn_dist {
+    ISBN_DIST_UNIFORM,
+    ISBN_DIST_WEIGHTED,
+};
+
+/*
+ * What kind of ISBN isbn_corpus_next() produced.
+ */
+
+enum isbn_kind {
+    ISBN_KIND_VALID,        // Assigned range, correct check digit
+    ISBN_KIND_INVALID,      // Assigned range, wrong check digit
+    ISBN_KIND_UNASSIGNED,   // Correct check digit, but no such range
+    ISBN_KIND_DUPLICATE,    // Repeat of an ISBN produced earlier
+};
+
+/*
+ * The fractions are probabilities in [0, 1].
+ * Whatever is left over after invalid, unassigned, and duplicate
+ * ISBNs is valid ISBNs.
+ *
+ * A seed of 0 selects a fixed default seed, so that an unconfigured
+ * generator is still reproducible.
+ */
+
+struct isbn_corpus_opts {
+    enum isbn_dist dist;
+    double   invalid;
+    double   unassigned;
+    double   duplicate;
+    uint64_t seed;
+};
+
+typedef struct isbn_corpus_opts isbn_corpus_opts_t;
+
+struct isbn_corpus;
+typedef struct isbn_corpus isbn_corpus_t;
+
+#define ISBN_CORPUS_HISTORY 4096
+
+extern isbn_corpus_t *isbn_corpus_new(isbn_info_t *isbn,
+    const isbn_corpus_opts_t *opts);
+extern void isbn_corpus_free(isbn_corpus_t *gen);
+extern enum isbn_kind isbn_corpus_next(isbn_corpus_t *gen, char *buf);
+extern enum isbn_kind isbn_corpus_next_u64(isbn_corpus_t *gen, uint64_t *isbn13);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif  /* _ISBN_CORPUS_H */
@@ -27,7 +27,13 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+    // Import type uint16_t
     // Import type uint32_t
+    // Import type uint64_t
+#include <stdio.h>
+    // Import type FILE
+#include <string.h>
+    // Import memcpy()
 #include <unistd.h>
     // Import type size_t
 
@@ -95,9 +101,9 @@ typedef struct isbn_range isbn_range_t;
 
 struct isbn_prefix {
     char *prefix;
-    char *agency;
     size_t rule_idx;    // Starting index into array of ranges
     size_t nrules;      // How many rules apply to this prefix
+    uint16_t agency_id; // Index into array of agency names
 };
 
 typedef struct isbn_prefix isbn_prefix_t;
@@ -131,6 +137,12 @@ typedef struct isbn_prefix isbn_prefix_t;
  *     The array grows during parsing.
  *     It is resized as needed.
  *
+ * agency_vec:
+ *     Interned agency names (char *), one for each distinct name,
+ *     in order of first appearance.  Many registration groups share
+ *     an agency, for example "English language", so each name
+ *     is stored once, and each prefix refers to it by |agency_id|.
+ *
  * rule_nr:
  *     Count of how many rules the parser has encountered, so far.
  *     Also, index use to append to |ranges_vec[]|.
@@ -146,6 +158,25 @@ typedef struct isbn_prefix isbn_prefix_t;
  * fst:
  *     The Finite-State Transducer (FST) that translates variable-length
  *     prefixes to rule numbers.
+ *     While parsing, it is the FST under construction;
+ *     after that, a packed copy.
+ *
+ * fst_builder_bytes:
+ *     Size of the FST under construction, just before it was packed
+ *     and freed.  Kept for isbn_mem_usage().
+ *
+ * build_bytes:
+ *     Total heap held by all of the above, at the end of parsing,
+ *     before anything was packed or compacted.  Kept for isbn_mem_usage().
+ *
+ * arena_size:
+ *     0 while the tables are under construction.
+ *     After isbn_finalize(), the size of the single allocation
+ *     that holds this header, the prefix and range tables,
+ *     their strings, and the packed FST.
+ *
+ * arena_flags:
+ *     How the arena was allocated; see ISBN_FINALIZE_*.
  *
  * err:
  *     Status of the parser and table builder and of the FST builder.
@@ -161,15 +192,37 @@ struct isbn_info {
     val_t cur_value;
     vec_t prefix_vec;
     vec_t ranges_vec;
+    vec_t agency_vec;
     size_t rule_nr;
     size_t prefix_nr;
     isbn_prefix_t new_prefix;
     fst_t *fst;
+    size_t fst_builder_bytes;
+    size_t build_bytes;
+    size_t arena_size;
+    unsigned int arena_flags;
     int err;
 };
 
 typedef struct isbn_info isbn_info_t;
 
+/*
+ * Flags for isbn_finalize().
+ *
+ * ISBN_FINALIZE_PROTECT:
+ *     Map the arena with mmap(), and make it read-only, so that
+ *     a stray write into the tables faults, instead of silently
+ *     corrupting lookups.  If mmap() fails, the arena is allocated
+ *     from the heap, unprotected, and this flag is cleared.
+ *
+ * ISBN_ARENA_MAPPED:
+ *     Set by isbn_finalize() if the arena was made by mmap(),
+ *     whether or not mprotect() then succeeded.
+ */
+
+#define ISBN_FINALIZE_PROTECT   0x0001
+#define ISBN_ARENA_MAPPED       0x0100
+
 /*
  * @var{path} is not a pathname or a list of pathnames a la env::PATH.
  * Rather, it is a list of xml path components, representing a stick
@@ -181,6 +234,218 @@ typedef struct isbn_info isbn_info_t;
 
 #define UNDEF_INDEX (size_t)(-1)
 
+#define ISBN_AGENCY_MAX UINT16_MAX
+
+/*
+ * The elements of an ISBN-13, in order.
+ */
+
+enum isbn_element {
+    ISBN_EL_PREFIX,         // EAN prefix element, 978 or 979
+    ISBN_EL_GROUP,          // Registration group
+    ISBN_EL_REGISTRANT,     // Registrant
+    ISBN_EL_PUBLICATION,    // Publication
+    ISBN_EL_CHECK,          // Check digit
+    ISBN_NELEMENTS
+};
+
+/*
+ * Everything that a lookup of one ISBN-13 finds out, in one pass.
+ *
+ * hyphenated:
+ *     The ISBN-13, with hyphens between elements.
+ *
+ * elem_off, elem_len:
+ *     Where each element is, in |hyphenated|.
+ *
+ * prefix_nr:
+ *     Index into |prefix_vec| of the registration group,
+ *     or UNDEF_INDEX if no prefix matched.
+ *
+ * rule_nr:
+ *     Index into |ranges_vec| of the range that holds the registrant,
+ *     or UNDEF_INDEX if no assigned range matched.
+ *
+ * agency_id, agency:
+ *     The agency for the registration group, and its interned name,
+ *     or NULL, if no prefix matched.
+ *
+ * On ERANGE, |prefix_nr|, |agency_id| and |agency| are set,
+ * but nothing else is.
+ */
+
+struct isbn_lookup {
+    char hyphenated[18];
+    uint8_t elem_off[ISBN_NELEMENTS];
+    uint8_t elem_len[ISBN_NELEMENTS];
+    uint16_t agency_id;
+    const char *agency;
+    size_t prefix_nr;
+    size_t rule_nr;
+};
+
+typedef struct isbn_lookup isbn_lookup_t;
+
+/*
+ * Where the four hyphens of an ISBN-13 go, packed into 16 bits,
+ * as made by isbn_hyphens_u64(): four 4-bit fields, each the number
+ * of digits before one hyphen, the first hyphen in the high nibble.
+ * For 978-0-306-40615-7, that is 0x347c.  0 means "not hyphenated".
+ */
+
+#define ISBN_HYPHENS_POS(hyphens, i) (((hyphens) >> (12 - 4 * (i))) & 0xf)
+
+/*
+ * A fixed-width binary output record: the ISBN-13 as a uint64_t,
+ * then its hyphen positions as a uint16_t, both in host byte order,
+ * with no padding, so that records can be read and written
+ * in large blocks, with no parsing.
+ */
+
+#define ISBN_BIN_REC_SIZE 10
+
+static inline void
+isbn_bin_rec_put(char *rec, uint64_t isbn13, uint16_t hyphens)
+{
+    memcpy(rec, &isbn13, sizeof (isbn13));
+    memcpy(rec + sizeof (isbn13), &hyphens, sizeof (hyphens));
+}
+
+static inline void
+isbn_bin_rec_get(const char *rec, uint64_t *isbn13_ref, uint16_t *hyphens_ref)
+{
+    memcpy(isbn13_ref, rec, sizeof (*isbn13_ref));
+    memcpy(hyphens_ref, rec + sizeof (*isbn13_ref), sizeof (*hyphens_ref));
+}
+
+/*
+ * A compact encoding of a hyphenated ISBN-13, in a single uint64_t,
+ * as made by isbn_pack_u64():
+ *
+ *     bits  0-43  The ISBN-13, as a number (10^13 < 2^44)
+ *     bits 44-47  Length of the registration group element, 1-5
+ *     bits 48-51  Length of the registrant element, 1-7
+ *
+ * The prefix element and the check digit are always 3 and 1 digits,
+ * and the publication element takes whatever is left.
+ * Lengths of 0 mean "not hyphenated".  The remaining bits are 0.
+ */
+
+#define ISBN_PACKED_ISBN_BITS 44
+#define ISBN_PACKED_ISBN_MASK ((UINT64_C(1) << ISBN_PACKED_ISBN_BITS) - 1)
+#define ISBN_PACKED_GROUP_LEN(p) \
+    ((unsigned int)((p) >> ISBN_PACKED_ISBN_BITS) & 0xf)
+#define ISBN_PACKED_REGISTRANT_LEN(p) \
+    ((unsigned int)((p) >> (ISBN_PACKED_ISBN_BITS + 4)) & 0xf)
+
+static inline uint64_t
+isbn_packed_make(uint64_t isbn13, unsigned int group_len,
+    unsigned int registrant_len)
+{
+    return ((isbn13 & ISBN_PACKED_ISBN_MASK)
+        | ((uint64_t)(group_len & 0xf) << ISBN_PACKED_ISBN_BITS)
+        | ((uint64_t)(registrant_len & 0xf) << (ISBN_PACKED_ISBN_BITS + 4)));
+}
+
+static inline uint64_t
+isbn_packed_isbn13(uint64_t packed)
+{
+    return (packed & ISBN_PACKED_ISBN_MASK);
+}
+
+// ########################### Functions (isbn-xml-to-fst.c)
+
+extern isbn_info_t *parse_isbn_range_table(const char *docname);
+extern isbn_info_t *parse_isbn_range_table_ex(const char *docname,
+    unsigned int flags);
+extern int hyphenate_isbn(isbn_info_t *isbn, char *hbuf, size_t bsz,
+    const char *isbn_str);
+extern int hyphenate_isbn_ex(isbn_info_t *isbn, char *hbuf, size_t bsz,
+    const char *isbn_str, size_t *prefix_nr);
+extern int hyphenate_isbn_u64(isbn_info_t *isbn, char *hbuf, size_t bsz,
+    uint64_t isbn13);
+extern int isbn_hyphens_u64(isbn_info_t *isbn, uint64_t isbn13,
+    uint16_t *hyphens_ref, size_t *prefix_nr);
+extern int isbn_pack_u64(isbn_info_t *isbn, uint64_t isbn13,
+    uint64_t *packed_ref, size_t *prefix_nr);
+extern int isbn_unpack(uint64_t packed, char *hbuf, size_t bsz);
+extern int isbn_lookup(isbn_info_t *isbn, const char *isbn_str,
+    isbn_lookup_t *res);
+extern int isbn_check_form(const char *isbn_str, size_t len);
+extern int isbn_validate(const char *isbn_str, size_t len);
+extern int isbn_check_and_lookup(isbn_info_t *isbn, const char *isbn_str,
+    size_t len, isbn_lookup_t *res);
+extern const char *isbn_status_code(int err);
+extern int isbn_agency_id(isbn_info_t *isbn, const char *isbn_str,
+    uint16_t *agency_id_ref);
+extern const char *isbn_agency(isbn_info_t *isbn, const char *isbn_str);
+
+/*
+ * The interned name of agency number |agency_id|, or NULL.
+ * The string belongs to |isbn|; do not free or modify it.
+ */
+static inline const char *
+isbn_agency_name(const isbn_info_t *isbn, unsigned int agency_id)
+{
+    if (agency_id >= isbn->agency_vec.len) {
+        return (NULL);
+    }
+    return (((char **)isbn->agency_vec.base)[agency_id]);
+}
+
+// ########################### Finalize (isbn-finalize.c)
+
+extern isbn_info_t *isbn_finalize(isbn_info_t *isbn, unsigned int flags);
+extern void isbn_info_free(isbn_info_t *isbn);
+
+// ########################### Memory accounting (isbn-mem.c)
+
+/*
+ * Bytes of heap held by each part of an isbn_info_t,
+ * not counting the allocator's own overhead; see |heap_in_use|.
+ *
+ * The _vec fields are allocated capacity; the _used fields
+ * are how much of that capacity holds elements.
+ *
+ * fst_builder is not part of |total|; it is the size of the
+ * FST as it was before packing, after which it was freed.
+ * Likewise, build_total is the |total| at the end of parsing,
+ * before the FST was packed and the tables were compacted.
+ *
+ * arena is the size of the single allocation made by isbn_finalize(),
+ * or 0 if the tables have not been finalized.  It is |total|,
+ * plus alignment padding.
+ *
+ * heap_in_use is the allocator's own count of bytes in use
+ * by the whole process, including overhead, or 0 if unknown.
+ */
+
+struct isbn_mem {
+    size_t info;
+    size_t xml_path;
+    size_t prefix_vec;
+    size_t prefix_vec_used;
+    size_t ranges_vec;
+    size_t ranges_vec_used;
+    size_t prefix_strings;
+    size_t agency_vec;
+    size_t agency_vec_used;
+    size_t agency_strings;
+    size_t parse_strings;
+    size_t fst;
+    size_t fst_builder;
+    size_t total;
+    size_t build_total;
+    size_t arena;
+    unsigned int arena_flags;
+    size_t heap_in_use;
+};
+
+typedef struct isbn_mem isbn_mem_t;
+
+extern void isbn_mem_usage(isbn_info_t *isbn, isbn_mem_t *mem);
+extern void fprint_isbn_mem(FILE *f, const isbn_mem_t *mem);
+
 
 #ifdef  __cplusplus
 }
@@ -0,0 +1,142 @@
+/*
+ * Filename: src/inc/isbn-lat.h
+ * Project: isbn-hyphenate
+ * Brief: Sampled latency histograms for the phases of a lookup
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ISBN_LAT_H
+#define _ISBN_LAT_H
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+    // Import type uint64_t
+#include <stdio.h>
+    // Import type FILE
+#include <time.h>
+    // Import clock_gettime()
+
+#include <lat-hist.h>
+
+/*
+ * Phases of hyphenate_isbn(), and of the I/O around it.
+ */
+
+enum isbn_lat_phase {
+    ISBN_LAT_PREFIX,    // FST walk for the registration group
+    ISBN_LAT_RANGE,     // Search of the group's range table
+    ISBN_LAT_HYPHENS,   // place_hyphens()
+    ISBN_LAT_READ,      // Reading one input record
+    ISBN_LAT_WRITE,     // Writing one result
+    ISBN_LAT_NPHASES
+};
+
+/*
+ * Each place that decides whether to sample keeps its own tick,
+ * so that sampling in one does not skew sampling in another.
+ */
+
+enum isbn_lat_site {
+    ISBN_LAT_SITE_LOOKUP,   // hyphenate_isbn()
+    ISBN_LAT_SITE_IO,       // The caller's read / write loop
+    ISBN_LAT_NSITES
+};
+
+/*
+ * One set of histograms per thread.
+ *
+ * Only one call in every |sample_every| (a power of 2) is timed,
+ * so the cost of reading the clock is spread thin.  An untimed call
+ * costs a thread-local load, an increment, and a test.
+ */
+
+struct isbn_lat {
+    uint64_t tickv[ISBN_LAT_NSITES];
+    uint64_t sample_mask;
+    lat_hist_t histv[ISBN_LAT_NPHASES];
+};
+
+typedef struct isbn_lat isbn_lat_t;
+
+extern __thread isbn_lat_t *isbn_lat_current;
+
+extern isbn_lat_t *isbn_lat_new(unsigned int sample_every);
+extern void isbn_lat_free(isbn_lat_t *lat);
+extern void isbn_lat_merge(isbn_lat_t *dst, const isbn_lat_t *src);
+extern void fdump_isbn_lat(FILE *f, const isbn_lat_t *lat);
+
+/*
+ * Turn latency sampling on for the calling thread, into |lat|,
+ * or off, if |lat| is NULL.  This can be done at any time.
+ */
+static inline void
+isbn_lat_set(isbn_lat_t *lat)
+{
+    isbn_lat_current = lat;
+}
+
+static inline uint64_t
+isbn_lat_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/*
+ * Decide whether to time this call, at |site|.
+ * Return the histograms to record into, and start the clock in |*t|,
+ * or return NULL.
+ */
+static inline isbn_lat_t *
+isbn_lat_sample(enum isbn_lat_site site, uint64_t *t)
+{
+    isbn_lat_t *lat = isbn_lat_current;
+
+    if (lat == NULL || (++lat->tickv[site] & lat->sample_mask) != 0) {
+        return (NULL);
+    }
+    *t = isbn_lat_now();
+    return (lat);
+}
+
+/*
+ * End a phase that started at |*t|, and start the next one.
+ */
+static inline void
+isbn_lat_phase(isbn_lat_t *lat, enum isbn_lat_phase phase, uint64_t *t)
+{
+    uint64_t now;
+
+    if (lat == NULL) {
+        return;
+    }
+    now = isbn_lat_now();
+    lat_hist_record(&lat->histv[phase], now - *t);
+    *t = now;
+}
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif  /* _ISBN_LAT_H */
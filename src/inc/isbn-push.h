@@ -0,0 +1,78 @@
+/*
+ * Filename: src/inc/isbn-push.h
+ * Project: isbn-hyphenate
+ * Brief: Push-style hyphenation of records that arrive in arbitrary chunks
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ISBN_PUSH_H
+#define _ISBN_PUSH_H
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+    // Import type uint64_t
+#include <unistd.h>
+    // Import type size_t
+
+#include <isbn-info.h>
+
+/*
+ * The caller hands over input as it arrives, in chunks of any size,
+ * with isbn_push_feed(), and gets one call of |fn| for every complete
+ * record, with the outcome of isbn_check_and_lookup().
+ *
+ * Records that lie wholly within one chunk are looked up in place,
+ * in the caller's buffer; nothing is copied.  Only the last, partial
+ * record of a chunk is kept, in |tail|, until a later chunk
+ * completes it.  No FILE, file descriptor, or line buffer is involved.
+ *
+ * The record passed to |fn| is not NUL-terminated, and is valid only
+ * for the duration of the call.  It does not include the delimiter.
+ * |res| is valid only for the duration of the call, too.
+ */
+
+typedef void isbn_push_fn_t(void *arg, const char *rec, size_t len,
+    int rv, const isbn_lookup_t *res);
+
+struct isbn_push {
+    isbn_info_t    *isbn;
+    isbn_push_fn_t *fn;
+    void           *arg;
+    int            delim;
+    char           *tail;       // Start of a record, from an earlier chunk
+    size_t         tail_len;
+    size_t         tail_size;
+    uint64_t       nrecords;    // Records handed to |fn|, so far
+};
+
+typedef struct isbn_push isbn_push_t;
+
+extern isbn_push_t *isbn_push_new(isbn_info_t *isbn, int delim,
+    isbn_push_fn_t *fn, void *arg);
+extern void isbn_push_feed(isbn_push_t *push, const void *buf, size_t n);
+extern void isbn_push_finish(isbn_push_t *push);
+extern void isbn_push_free(isbn_push_t *push);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif  /* _ISBN_PUSH_H */
@@ -0,0 +1,145 @@
+/*
+ * Filename: src/inc/isbn-stats.h
+ * Project: isbn-hyphenate
+ * Brief: Counters for a stream of ISBN lookups
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ISBN_STATS_H
+#define _ISBN_STATS_H
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <errno.h>
+    // Import var EBADMSG
+    // Import var EINVAL
+    // Import var ENOENT
+    // Import var ERANGE
+#include <stdbool.h>
+    // Import type bool
+#include <stdint.h>
+    // Import type uint64_t
+#include <stdio.h>
+    // Import type FILE
+#include <unistd.h>
+    // Import type size_t
+
+#include <isbn-info.h>
+
+/*
+ * Counters are plain integers, not atomics.  Each thread keeps its
+ * own isbn_stats_t, and they are combined with isbn_stats_merge()
+ * when it is time to report.
+ *
+ * lines:
+ *     Input records read, including empty ones.
+ *
+ * lookups:
+ *     ISBNs examined: calls to hyphenate_isbn(), plus those rejected
+ *     before it, by isbn_check_form(), or, in modes that validate
+ *     input first, by isbn_validate().
+ *
+ * ok, err_length, err_check, err_prefix, err_range, err_other:
+ *     Outcome of each lookup.  err_length counts EINVAL (not 13 digits),
+ *     in every mode; err_check counts EBADMSG (bad check digit),
+ *     only in modes that validate.
+ *     err_prefix counts ENOENT (no registration group matches);
+ *     err_range counts ERANGE (the group is known, but no assigned
+ *     range matches), which is the usual sign of a stale range table.
+ *
+ * bytes_in, bytes_out:
+ *     Including line terminators.
+ *
+ * ns_parse, ns_lookup, ns_output:
+ *     Time spent reading and splitting input, in hyphenate_isbn(),
+ *     and writing results.
+ *
+ * group_ok, group_err_range:
+ *     Per registration group, indexed by prefix number.
+ */
+
+struct isbn_stats {
+    uint64_t lines;
+    uint64_t lookups;
+    uint64_t ok;
+    uint64_t err_length;
+    uint64_t err_check;
+    uint64_t err_prefix;
+    uint64_t err_range;
+    uint64_t err_other;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t ns_parse;
+    uint64_t ns_lookup;
+    uint64_t ns_output;
+    size_t   ngroups;
+    uint64_t *group_ok;
+    uint64_t *group_err_range;
+};
+
+typedef struct isbn_stats isbn_stats_t;
+
+extern isbn_stats_t *isbn_stats_new(isbn_info_t *isbn);
+extern void isbn_stats_free(isbn_stats_t *stats);
+extern void isbn_stats_merge(isbn_stats_t *dst, const isbn_stats_t *src);
+extern void fprint_isbn_stats(FILE *f, const isbn_stats_t *stats,
+    isbn_info_t *isbn, bool json);
+
+/*
+ * Count the outcome of one lookup.
+ * |prefix_nr| is as set by hyphenate_isbn_ex().
+ */
+static inline void
+isbn_stats_count(isbn_stats_t *stats, int rc, size_t prefix_nr)
+{
+    ++stats->lookups;
+    switch (rc) {
+    case 0:
+        ++stats->ok;
+        if (prefix_nr < stats->ngroups) {
+            ++stats->group_ok[prefix_nr];
+        }
+        break;
+    case EINVAL:
+        ++stats->err_length;
+        break;
+    case EBADMSG:
+        ++stats->err_check;
+        break;
+    case ENOENT:
+        ++stats->err_prefix;
+        break;
+    case ERANGE:
+        ++stats->err_range;
+        if (prefix_nr < stats->ngroups) {
+            ++stats->group_err_range[prefix_nr];
+        }
+        break;
+    default:
+        ++stats->err_other;
+        break;
+    }
+}
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif  /* _ISBN_STATS_H */
@@ -0,0 +1,101 @@
+/*
+ * Filename: lat-hist.h
+ * Library: libcscript
+ * Brief: Log-linear latency histograms, cheap to record, easy to merge
+ *
+ * Copyright (C) 2015-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LAT_HIST_H
+#define _LAT_HIST_H
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+    // Import type uint64_t
+#include <stdio.h>
+    // Import type FILE
+
+/*
+ * Buckets are log-linear, in the style of HdrHistogram:
+ * values below 32 each get their own bucket; above that, every
+ * power of two is split into 32 equal sub-buckets.  So, any value
+ * is recorded to within about 3%, from 1 nanosecond to over
+ * 9 minutes, in a fixed set of 1152 buckets.
+ *
+ * Bucket boundaries never change, so histograms from different
+ * threads, processes, or hosts can be merged by adding counts.
+ */
+
+#define LAT_HIST_SUB_BITS  5
+#define LAT_HIST_SUB       (1 << LAT_HIST_SUB_BITS)
+#define LAT_HIST_MAX_EXP   40
+#define LAT_HIST_NBUCKETS  ((LAT_HIST_MAX_EXP - LAT_HIST_SUB_BITS + 1) * LAT_HIST_SUB)
+
+struct lat_hist {
+    const char *name;
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t bucketv[LAT_HIST_NBUCKETS];
+};
+
+typedef struct lat_hist lat_hist_t;
+
+static inline unsigned int
+lat_hist_bucket(uint64_t v)
+{
+    unsigned int e;
+    unsigned int idx;
+
+    if (v < LAT_HIST_SUB) {
+        return ((unsigned int)v);
+    }
+    e = 63 - __builtin_clzll(v);
+    idx = (e - LAT_HIST_SUB_BITS + 1) * LAT_HIST_SUB
+        + (unsigned int)((v >> (e - LAT_HIST_SUB_BITS)) - LAT_HIST_SUB);
+    return (idx < LAT_HIST_NBUCKETS ? idx : LAT_HIST_NBUCKETS - 1);
+}
+
+static inline void
+lat_hist_record(lat_hist_t *h, uint64_t v)
+{
+    ++h->bucketv[lat_hist_bucket(v)];
+    ++h->count;
+    h->sum += v;
+    if (v < h->min) {
+        h->min = v;
+    }
+    if (v > h->max) {
+        h->max = v;
+    }
+}
+
+extern void lat_hist_init(lat_hist_t *h, const char *name);
+extern uint64_t lat_hist_bucket_lbound(unsigned int idx);
+extern void lat_hist_merge(lat_hist_t *dst, const lat_hist_t *src);
+extern uint64_t lat_hist_quantile(const lat_hist_t *h, double q);
+extern void fdump_lat_hist(FILE *f, const lat_hist_t *h);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif  /* _LAT_HIST_H */
@@ -39,6 +39,8 @@ extern "C" {
  *
  */
 
+#include <stdint.h>
+    // Import type uint8_t
 #include <stdio.h>
     // Import type FILE
 #include <unistd.h>
@@ -140,37 +142,90 @@ typedef struct trans trans_t;
 struct fst_state {
     trans_t *transv;
     size_t ntrans;
+    val_t  fval;        // Value to return, if this is a final state
+    bool   final;
 };
 
 typedef struct fst_state fst_state_t;
 
-#if 0
-typedef vec_t fst_t;
-#endif
+/*
+ * Jump table
+ * ----------
+ * An optional accelerator, built by fst_copy_and_pack_jump().
+ *
+ * The first |depth| steps of every walk are replaced by a single
+ * lookup in a direct-mapped table.  Each of the first |depth| bytes
+ * of the input is mapped, through the byte-class map for its position,
+ * to a small number; those numbers are the digits of a mixed-radix
+ * index into |statev|, which holds the state reached after |depth|
+ * steps, or UNDEF_STATE if there is no such path.
+ *
+ * classv[l][byte] is 0 if no transition out of any state at depth |l|
+ * is on |byte|; otherwise it is 1 + the class number of |byte|.
+ *
+ * No state at depth less than |depth| is final, so skipping those
+ * steps cannot skip over a match, and a missing path is simply ENOENT.
+ */
+
+#define FST_JUMP_MAX_DEPTH 8
+
+struct fst_jump {
+    size_t  depth;
+    size_t  nentries;
+    size_t  stridev[FST_JUMP_MAX_DEPTH];
+    uint8_t (*classv)[256];
+    state_t *statev;
+};
+
+typedef struct fst_jump fst_jump_t;
 
 /*
- * A final state has just 1 transition, and that transition has
- * t_chr == 0.  That is, it is structured as if it is a transition
- * from the NUL byte to some new state, but for a final state,
- * what would have been the next state is a value to be returned.
+ * fst_t is an array of fst_state_t, plus the optional jump table.
+ */
+
+struct fst {
+    vec_t      states;
+    fst_jump_t *jump;
+    bool       packed;      // One allocation, made by fst_copy_and_pack()
+};
+
+/*
+ * A cursor over the keys of an FST, in lexicographic order
+ * (bytes compared as unsigned).
+ *
+ * stackv[0 .. depth] are the states along the path from the start
+ * state to the current key; key[0 .. depth-1] are the bytes along
+ * that same path.  Both are allocated once, by fst_cursor_new(),
+ * big enough for the longest key in the FST.
+ *
+ * plen is the length of the prefix that iteration is restricted to.
+ * The cursor never climbs above that depth.
+ */
+
+struct fst_cursor {
+    fst_t   *fst;
+    state_t *stackv;
+    char    *key;
+    size_t  depth;
+    size_t  maxdepth;
+    size_t  plen;
+    bool    valid;
+};
+
+/*
+ * Whether a state is final is recorded in the state itself,
+ * separately from its outgoing transitions.  So, a final state
+ * can also have transitions to longer keys.  That is, one key
+ * can be a proper prefix of another key.
  */
 
 static inline bool
 is_final_state(fst_t *fst, state_t state)
 {
     fst_state_t *s0;
-    fst_state_t *sv;
-    size_t ntrans;
-    int chr;
-
-    s0 = (fst_state_t *)fst->base;
-    sv = s0 + state;
-    ntrans = sv->ntrans;
-    if (ntrans > 1) {
-        return (false);
-    }
-    chr = sv->transv[0].t_chr & 0xFF;
-    return (chr == 0);
+
+    s0 = (fst_state_t *)fst->states.base;
+    return (s0[state].final);
 }
 
 // #################### Implementation-private Functions
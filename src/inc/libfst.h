@@ -29,6 +29,8 @@ extern "C" {
 
 #include <vec.h>
 
+#include <stdint.h>
+    // Import type uint64_t
 #include <stdio.h>
     // Import type FILE
 #include <unistd.h>
@@ -41,13 +43,25 @@ extern "C" {
 
 typedef size_t val_t;
 
+/*
+ * Default limit on the number of entries in the jump table
+ * built by fst_copy_and_pack().  See fst_copy_and_pack_jump().
+ */
+#define FST_JUMP_DEFAULT_ENTRIES 4096
+
+/*
+ * Callback for fst_lookup_all_prefixes().
+ * Called once for each matching prefix, with the length of the prefix
+ * and its value.  Return non-zero to stop the walk.
+ */
+typedef int (*fst_match_fn_t)(void *arg, size_t len, val_t val);
+
 
-#ifdef LIBFST_IMPL
-typedef vec_t fst_t;
-#else
 struct fst;
 typedef struct fst fst_t;
-#endif
+
+struct fst_cursor;
+typedef struct fst_cursor fst_cursor_t;
 
 // #################### Functions
 
@@ -56,10 +70,36 @@ extern fst_t *fst_new(void);
 extern int fst_add_string(fst_t *fst, const char *str, val_t val);
 extern void fdump_fst(FILE *f, fst_t *fst);
 extern fst_t *fst_copy_and_pack(fst_t *src_fst);
+extern fst_t *fst_copy_and_pack_jump(fst_t *src_fst, size_t max_entries);
+extern size_t fst_jump_depth(fst_t *fst);
 extern void   fst_pack(fst_t *dst_fst, fst_t *src_fst);
 extern size_t fst_measure(fst_t *fst);
+extern size_t fst_mem_bytes(fst_t *fst);
+extern void   fst_free(fst_t *fst);
 extern int fst_lookup_string(fst_t *fst, const char *str, val_t *val_ret_ref);
 extern int fst_lookup_prefix(fst_t *fst, const char *str, val_t *val_ret_ref);
+extern int fst_lookup_prefix_u64(fst_t *fst, uint64_t key, size_t ndigits,
+    val_t *val_ret_ref);
+extern int fst_lookup_longest_prefix(fst_t *fst, const char *str,
+    val_t *val_ret_ref, size_t *len_ret_ref);
+extern int fst_lookup_all_prefixes(fst_t *fst, const char *str,
+    fst_match_fn_t fn, void *arg);
+extern size_t fst_lookup_prefix_batch(fst_t *fst, const char **keys, size_t n,
+    val_t *vals, int *errs);
+
+// Ordered iteration (fst-cursor.c)
+
+extern fst_cursor_t *fst_cursor_new(fst_t *fst);
+extern void   fst_cursor_free(fst_cursor_t *cur);
+extern int    fst_cursor_first(fst_cursor_t *cur);
+extern int    fst_cursor_seek(fst_cursor_t *cur, const char *lbound);
+extern int    fst_cursor_prefix(fst_cursor_t *cur, const char *prefix);
+extern int    fst_cursor_next(fst_cursor_t *cur);
+extern bool   fst_cursor_valid(fst_cursor_t *cur);
+extern const char *fst_cursor_key(fst_cursor_t *cur);
+extern size_t fst_cursor_keylen(fst_cursor_t *cur);
+extern val_t  fst_cursor_value(fst_cursor_t *cur);
+extern void   fexport_fst(FILE *f, fst_t *fst);
 
 #ifdef  __cplusplus
 }
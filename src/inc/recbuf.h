@@ -0,0 +1,84 @@
+/*
+ * Filename: recbuf.h
+ * Library: libcscript
+ * Brief: Read delimited records from a file descriptor, a block at a time
+ *
+ * Copyright (C) 2015-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _RECBUF_H
+#define _RECBUF_H
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+    // Import type bool
+#include <unistd.h>
+    // Import type size_t
+    // Import type ssize_t
+
+/*
+ * A record reader for any single-byte delimiter, including NUL.
+ *
+ * Input is read with read(2), a block at a time, into one buffer,
+ * and records are found with memchr().  Each record is returned
+ * in place, with its delimiter overwritten by a NUL, so there is
+ * no per-record copy and no per-character call.
+ *
+ * Unread data is slid down to the start of the buffer only when
+ * a record runs off the end; the buffer grows only when a single
+ * record is bigger than the whole buffer.
+ *
+ * buf[head .. tail) is data that has been read, but not yet returned.
+ * buf[head .. scan) is known not to contain the delimiter.
+ *
+ * By default, input is read(2) from |fd|; recbuf_set_reader()
+ * substitutes any function with the same contract, such as one
+ * that decompresses.
+ */
+
+typedef ssize_t recbuf_read_fn_t(void *arg, void *buf, size_t n);
+
+struct recbuf {
+    int    fd;
+    recbuf_read_fn_t *read_fn;
+    void   *read_arg;
+    char   *buf;
+    size_t size;
+    size_t head;
+    size_t tail;
+    size_t scan;
+    int    err;
+    bool   eof;
+};
+
+typedef struct recbuf recbuf_t;
+
+#define RECBUF_SIZE_DEFAULT (64 * 1024)
+
+extern recbuf_t *recbuf_new(int fd, size_t size);
+extern void recbuf_free(recbuf_t *rb);
+extern void recbuf_set_reader(recbuf_t *rb, recbuf_read_fn_t *fn, void *arg);
+extern char *recbuf_getrec(recbuf_t *rb, int delim, size_t *len_ref);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif  /* _RECBUF_H */
@@ -0,0 +1,96 @@
+/*
+ * Filename: src/inc/zstream.h
+ * Project: libcscript
+ * Brief: Compressed input and output streams, with the codec on threads
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ZSTREAM_H
+#define _ZSTREAM_H
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+    // Import type bool
+#include <stdio.h>
+    // Import type FILE
+#include <unistd.h>
+    // Import type size_t
+    // Import type ssize_t
+
+/*
+ * gzip is always there, using zlib.  zstd is there only if built
+ * with HAVE_ZSTD (make ZSTD=1); otherwise zstd input is recognized,
+ * so that it can be reported, but it cannot be read.
+ *
+ * Input: a zin_t reads from a file descriptor, and hands back plain
+ * bytes, with the same contract as read(2).  The decoder runs on
+ * a thread of its own, a block ahead of the caller, through a ring
+ * of |depth| blocks, so decoding overlaps whatever the caller does
+ * with the data.  With ZS_AUTO, the first bytes decide the codec;
+ * anything that is not compressed is passed through, with no thread.
+ * Concatenated gzip members and zstd frames are read as one stream.
+ *
+ * Output: a zout_t takes plain bytes, a block at a time, and
+ * compresses each block on one of |nthreads| threads, as a gzip
+ * member or a zstd frame of its own.  Blocks are written to the
+ * file descriptor in order, so the result is one valid stream.
+ * At most |depth| blocks are in the pipeline; beyond that,
+ * zout_write() waits.
+ */
+
+enum zs_codec {
+    ZS_NONE,
+    ZS_AUTO,
+    ZS_GZIP,
+    ZS_ZSTD,
+};
+
+typedef enum zs_codec zs_codec_t;
+
+struct zin;
+typedef struct zin zin_t;
+
+struct zout;
+typedef struct zout zout_t;
+
+#define ZS_BSIZE_DEFAULT    (256 * 1024)
+#define ZS_DEPTH_DEFAULT    4
+
+extern zs_codec_t zs_sniff(const void *buf, size_t len);
+extern const char *zs_codec_name(zs_codec_t codec);
+extern bool zs_codec_available(zs_codec_t codec);
+
+extern int zin_open(zin_t **zin_ref, int fd, zs_codec_t codec);
+extern ssize_t zin_read(void *zin, void *buf, size_t n);
+extern zs_codec_t zin_codec(const zin_t *zin);
+extern int zin_close(zin_t *zin);
+
+extern int zout_open(zout_t **zout_ref, int fd, zs_codec_t codec, int level,
+    unsigned int nthreads);
+extern int zout_write(zout_t *zout, const void *buf, size_t n);
+extern FILE *zout_fopen(zout_t *zout);
+extern int zout_close(zout_t *zout);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif  /* _ZSTREAM_H */
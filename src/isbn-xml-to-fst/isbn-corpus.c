@@ -0,0 +1,446 @@
+/*
+ * Filename: src/isbn-xml-to-fst/isbn-corpus.c
+ * Project: isbn-hyphenate
+ * Library: isbn-xml-to-fst
+ * Brief: Generate synthetic ISBN-13s from the range table
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Every ISBN is built the same way as a real one is assigned:
+ * pick a registration group (prefix), pick a range in that group's
+ * range table, pick a registrant-and-publication number inside the
+ * range, then append the check digit.  So, the ISBNs exercise the
+ * same paths through the FST and the range tables that real input
+ * does, and, unlike real input, they can be shared freely.
+ *
+ * The generator is deterministic for a given seed and range table.
+ */
+
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stddef.h>
+    // Import constant NULL
+#include <stdint.h>
+    // Import type uint32_t
+    // Import type uint64_t
+#include <stdio.h>
+    // Import snprintf()
+#include <stdlib.h>
+    // Import free()
+    // Import strtoull()
+#include <string.h>
+    // Import memcpy()
+    // Import memset()
+    // Import strcmp()
+    // Import strlen()
+#include <unistd.h>
+    // Import type size_t
+
+#include <cscript.h>
+#include <isbn-corpus.h>
+#include <isbn-info.h>
+
+struct isbn_corpus {
+    isbn_info_t *isbn;
+    isbn_corpus_opts_t opts;
+    uint64_t rng;
+
+    // Cumulative weights over prefix_vec[], for choosing a group.
+    uint64_t *cumwv;
+    uint64_t total_weight;
+
+    // Index into ranges_vec[] of every unassigned range,
+    // and the prefix it belongs to.
+    size_t *unassigned_rngv;
+    size_t *unassigned_pfxv;
+    size_t nunassigned;
+
+    // Ring of recently produced ISBNs, for duplicates.
+    uint64_t histv[ISBN_CORPUS_HISTORY];
+    size_t nhist;
+    size_t hist_nr;
+};
+
+/*
+ * Rough share of traffic, in percent, by registration group.
+ * All other groups share what is left over, evenly.
+ */
+
+struct group_weight {
+    const char *prefix;
+    unsigned int weight;
+};
+
+static const struct group_weight popular_groups[] = {
+    { "9780",  30 },
+    { "9781",  22 },
+    { "9783",   8 },
+    { "9782",   6 },
+    { "9787",   6 },
+    { "9784",   4 },
+    { "9785",   3 },
+    { "97884",  3 },
+    { "97888",  2 },
+    { "97885",  2 },
+    { "97890",  1 },
+    { "97889",  1 },
+};
+
+#define OTHER_GROUPS_WEIGHT 12
+
+/*
+ * Scale weights, so that OTHER_GROUPS_WEIGHT can be divided among
+ * a few hundred groups without rounding any of them down to zero.
+ */
+#define WEIGHT_SCALE 100000
+
+static inline uint64_t
+rng_next(isbn_corpus_t *gen)
+{
+    // xorshift64*
+    gen->rng ^= gen->rng >> 12;
+    gen->rng ^= gen->rng << 25;
+    gen->rng ^= gen->rng >> 27;
+    return (gen->rng * 2685821657736338717ULL);
+}
+
+static inline uint64_t
+rng_below(isbn_corpus_t *gen, uint64_t n)
+{
+    return ((rng_next(gen) >> 11) % n);
+}
+
+/*
+ * Uniform in [0, 1).
+ */
+static inline double
+rng_unit(isbn_corpus_t *gen)
+{
+    return ((rng_next(gen) >> 11) * (1.0 / 9007199254740992.0));
+}
+
+static int
+isbn13_check_digit(const char *digits)
+{
+    int sum = 0;
+    int i;
+
+    for (i = 0; i < 12; ++i) {
+        sum += (digits[i] - '0') * ((i & 1) ? 3 : 1);
+    }
+    return ((10 - sum % 10) % 10);
+}
+
+static size_t
+count_assigned(isbn_info_t *isbn, isbn_prefix_t *pfx)
+{
+    isbn_range_t *rules;
+    size_t count;
+    size_t i;
+
+    rules = (isbn_range_t *)isbn->ranges_vec.base + pfx->rule_idx;
+    count = 0;
+    for (i = 0; i < pfx->nrules; ++i) {
+        count += (rules[i].rng_len != 0);
+    }
+    return (count);
+}
+
+static unsigned int
+popular_weight(const char *prefix)
+{
+    size_t npopular = sizeof (popular_groups) / sizeof (popular_groups[0]);
+    size_t i;
+
+    for (i = 0; i < npopular; ++i) {
+        if (strcmp(prefix, popular_groups[i].prefix) == 0) {
+            return (popular_groups[i].weight);
+        }
+    }
+    return (0);
+}
+
+static void
+init_weights(isbn_corpus_t *gen)
+{
+    isbn_info_t *isbn = gen->isbn;
+    isbn_prefix_t *pfxtbl;
+    uint64_t *wv;
+    size_t nprefixes;
+    size_t nother;
+    uint64_t cum;
+    size_t i;
+
+    pfxtbl = (isbn_prefix_t *)isbn->prefix_vec.base;
+    nprefixes = isbn->prefix_vec.len;
+    wv = (uint64_t *)guard_calloc(nprefixes, sizeof (uint64_t));
+
+    nother = 0;
+    for (i = 0; i < nprefixes; ++i) {
+        if (count_assigned(isbn, &pfxtbl[i]) == 0) {
+            continue;
+        }
+        if (gen->opts.dist == ISBN_DIST_UNIFORM) {
+            wv[i] = 1;
+        }
+        else {
+            wv[i] = (uint64_t)popular_weight(pfxtbl[i].prefix) * WEIGHT_SCALE;
+            nother += (wv[i] == 0);
+        }
+    }
+
+    if (gen->opts.dist == ISBN_DIST_WEIGHTED && nother != 0) {
+        uint64_t w = (uint64_t)OTHER_GROUPS_WEIGHT * WEIGHT_SCALE / nother;
+        for (i = 0; i < nprefixes; ++i) {
+            if (wv[i] == 0 && count_assigned(isbn, &pfxtbl[i]) != 0) {
+                wv[i] = w ? w : 1;
+            }
+        }
+    }
+
+    cum = 0;
+    for (i = 0; i < nprefixes; ++i) {
+        cum += wv[i];
+        wv[i] = cum;
+    }
+    gen->cumwv = wv;
+    gen->total_weight = cum;
+}
+
+static void
+init_unassigned(isbn_corpus_t *gen)
+{
+    isbn_info_t *isbn = gen->isbn;
+    isbn_prefix_t *pfxtbl;
+    isbn_range_t *rngtbl;
+    size_t pnr;
+    size_t i;
+    size_t n;
+
+    pfxtbl = (isbn_prefix_t *)isbn->prefix_vec.base;
+    rngtbl = (isbn_range_t *)isbn->ranges_vec.base;
+    gen->unassigned_rngv = (size_t *)guard_calloc(isbn->ranges_vec.len + 1, sizeof (size_t));
+    gen->unassigned_pfxv = (size_t *)guard_calloc(isbn->ranges_vec.len + 1, sizeof (size_t));
+    n = 0;
+    for (pnr = 0; pnr < isbn->prefix_vec.len; ++pnr) {
+        isbn_prefix_t *pfx = &pfxtbl[pnr];
+        for (i = pfx->rule_idx; i < pfx->rule_idx + pfx->nrules; ++i) {
+            if (rngtbl[i].rng_len == 0) {
+                gen->unassigned_rngv[n] = i;
+                gen->unassigned_pfxv[n] = pnr;
+                ++n;
+            }
+        }
+    }
+    gen->nunassigned = n;
+}
+
+/**
+ * @brief Create a generator of synthetic ISBN-13s.
+ *
+ * @param isbn  in  Range table, as returned by parse_isbn_range_table().
+ * @param opts  in  Distribution, error fractions, and seed.
+ *                  NULL means weighted, all valid, default seed.
+ *
+ * The range table must stay alive as long as the generator.
+ */
+isbn_corpus_t *
+isbn_corpus_new(isbn_info_t *isbn, const isbn_corpus_opts_t *opts)
+{
+    isbn_corpus_t *gen;
+
+    gen = (isbn_corpus_t *)guard_malloc(sizeof (isbn_corpus_t));
+    memset(gen, 0, sizeof (isbn_corpus_t));
+    gen->isbn = isbn;
+    if (opts) {
+        gen->opts = *opts;
+    }
+    else {
+        gen->opts.dist = ISBN_DIST_WEIGHTED;
+    }
+    gen->rng = gen->opts.seed ? gen->opts.seed : 0x9E3779B97F4A7C15ULL;
+    init_weights(gen);
+    init_unassigned(gen);
+    return (gen);
+}
+
+void
+isbn_corpus_free(isbn_corpus_t *gen)
+{
+    if (gen == NULL) {
+        return;
+    }
+    free(gen->cumwv);
+    free(gen->unassigned_rngv);
+    free(gen->unassigned_pfxv);
+    free(gen);
+}
+
+static size_t
+pick_prefix(isbn_corpus_t *gen)
+{
+    uint64_t r;
+    size_t lo, hi;
+
+    // Smallest i such that cumwv[i] > r
+    r = rng_below(gen, gen->total_weight);
+    lo = 0;
+    hi = gen->isbn->prefix_vec.len - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (gen->cumwv[mid] > r) {
+            hi = mid;
+        }
+        else {
+            lo = mid + 1;
+        }
+    }
+    return (lo);
+}
+
+/*
+ * Fill in the 12 digits of an ISBN-13 that precede the check digit,
+ * for prefix number |pnr| and a value chosen from range number |rnr|.
+ *
+ * Ranges apply to the 7 digits that follow the prefix.  When fewer
+ * than 7 digits remain, only the leading ones matter; when more
+ * remain, the digits past the 7th are free.
+ */
+static void
+fill_digits(isbn_corpus_t *gen, size_t pnr, size_t rnr, char *buf)
+{
+    isbn_prefix_t *pfx;
+    isbn_range_t *rng;
+    char vbuf[16];
+    uint32_t value;
+    size_t pfxlen;
+    size_t avail;
+    size_t ndig;
+    size_t i;
+
+    pfx = (isbn_prefix_t *)gen->isbn->prefix_vec.base + pnr;
+    rng = (isbn_range_t *)gen->isbn->ranges_vec.base + rnr;
+    value = rng->rng_lbound
+        + (uint32_t)rng_below(gen, (uint64_t)rng->rng_ubound - rng->rng_lbound + 1);
+
+    pfxlen = strlen(pfx->prefix);
+    memcpy(buf, pfx->prefix, pfxlen);
+    avail = 12 - pfxlen;
+    ndig = avail < 7 ? avail : 7;
+    snprintf(vbuf, sizeof (vbuf), "%07u", value);
+    memcpy(buf + pfxlen, vbuf, ndig);
+    for (i = pfxlen + ndig; i < 12; ++i) {
+        buf[i] = '0' + rng_below(gen, 10);
+    }
+}
+
+static void
+make_assigned(isbn_corpus_t *gen, char *buf)
+{
+    isbn_prefix_t *pfx;
+    isbn_range_t *rules;
+    size_t pnr;
+    size_t pick;
+    size_t i;
+
+    pnr = pick_prefix(gen);
+    pfx = (isbn_prefix_t *)gen->isbn->prefix_vec.base + pnr;
+    rules = (isbn_range_t *)gen->isbn->ranges_vec.base + pfx->rule_idx;
+    pick = rng_below(gen, count_assigned(gen->isbn, pfx));
+    for (i = 0; i < pfx->nrules; ++i) {
+        if (rules[i].rng_len != 0 && pick-- == 0) {
+            break;
+        }
+    }
+    fill_digits(gen, pnr, pfx->rule_idx + i, buf);
+}
+
+static void
+remember(isbn_corpus_t *gen, const char *buf)
+{
+    gen->histv[gen->hist_nr] = strtoull(buf, NULL, 10);
+    gen->hist_nr = (gen->hist_nr + 1) % ISBN_CORPUS_HISTORY;
+    if (gen->nhist < ISBN_CORPUS_HISTORY) {
+        ++gen->nhist;
+    }
+}
+
+/**
+ * @brief Produce the next synthetic ISBN-13.
+ *
+ * @param gen  in   Generator
+ * @param buf  out  At least 14 bytes; receives 13 digits and a NUL.
+ *
+ * @return The kind of ISBN written to |buf|.
+ *
+ * If the range table has no unassigned ranges, or nothing has been
+ * produced yet to duplicate, a valid ISBN is produced instead.
+ */
+enum isbn_kind
+isbn_corpus_next(isbn_corpus_t *gen, char *buf)
+{
+    enum isbn_kind kind;
+    double r;
+    int chk;
+
+    r = rng_unit(gen);
+    if (r < gen->opts.duplicate && gen->nhist != 0) {
+        uint64_t dup = gen->histv[rng_below(gen, gen->nhist)];
+        snprintf(buf, 14, "%013llu", (unsigned long long)dup);
+        return (ISBN_KIND_DUPLICATE);
+    }
+    r -= gen->opts.duplicate;
+
+    if (r >= 0 && r < gen->opts.unassigned && gen->nunassigned != 0) {
+        size_t u = rng_below(gen, gen->nunassigned);
+        fill_digits(gen, gen->unassigned_pfxv[u], gen->unassigned_rngv[u], buf);
+        kind = ISBN_KIND_UNASSIGNED;
+    }
+    else {
+        make_assigned(gen, buf);
+        kind = ISBN_KIND_VALID;
+    }
+    r -= gen->opts.unassigned;
+
+    chk = isbn13_check_digit(buf);
+    if (kind == ISBN_KIND_VALID && r >= 0 && r < gen->opts.invalid) {
+        chk = (chk + 1 + rng_below(gen, 9)) % 10;
+        kind = ISBN_KIND_INVALID;
+    }
+    buf[12] = '0' + chk;
+    buf[13] = '\0';
+    remember(gen, buf);
+    return (kind);
+}
+
+/**
+ * @brief Same as isbn_corpus_next(), but return the ISBN-13 as a number.
+ */
+enum isbn_kind
+isbn_corpus_next_u64(isbn_corpus_t *gen, uint64_t *isbn13)
+{
+    char buf[14];
+    enum isbn_kind kind;
+
+    kind = isbn_corpus_next(gen, buf);
+    *isbn13 = strtoull(buf, NULL, 10);
+    return (kind);
+}
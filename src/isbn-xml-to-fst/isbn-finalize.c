@@ -0,0 +1,251 @@
+/*
+ * Filename: src/isbn-xml-to-fst/isbn-finalize.c
+ * Project: isbn-hyphenate
+ * Library: isbn-xml-to-fst
+ * Brief: Compact the range tables and the FST into one read-only arena
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+    // Import constant NULL
+#include <stdlib.h>
+    // Import free()
+#include <string.h>
+    // Import memcpy()
+    // Import memset()
+    // Import strlen()
+#include <sys/mman.h>
+    // Import mmap()
+    // Import mprotect()
+    // Import munmap()
+#include <unistd.h>
+    // Import type size_t
+
+#include <cscript.h>
+#include <isbn-info.h>
+#include <libfst.h>
+
+/*
+ * Every table in the arena starts on a boundary this coarse,
+ * which is enough for any of the structures that go into it.
+ */
+
+#define ARENA_ALIGN 16
+
+static inline size_t
+arena_align(size_t n)
+{
+    return ((n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1));
+}
+
+static char *
+arena_alloc(size_t size, unsigned int *flags_ref)
+{
+    void *mem;
+
+    if (*flags_ref & ISBN_FINALIZE_PROTECT) {
+        mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem != MAP_FAILED) {
+            *flags_ref |= ISBN_ARENA_MAPPED;
+            return ((char *)mem);
+        }
+        *flags_ref &= ~ISBN_FINALIZE_PROTECT;
+    }
+    return ((char *)guard_malloc(size));
+}
+
+static char *
+copy_str(char **spp, const char *s)
+{
+    char *dst = *spp;
+    size_t sz = strlen(s) + 1;
+
+    memcpy(dst, s, sz);
+    *spp += sz;
+    return (dst);
+}
+
+/**
+ * @brief Release everything that was needed only to build the tables,
+ * and move what is left into a single allocation.
+ *
+ * The arena is laid out as:
+ *
+ *     isbn_info_t header
+ *     prefix table        (exactly |prefix_nr| entries, no slack)
+ *     range table         (exactly |rule_nr| entries, no slack)
+ *     agency table        (one pointer per distinct agency)
+ *     packed FST          (including its jump table)
+ *     prefix strings, and agency strings (each name once)
+ *
+ * The XML path stack, the parser's current prefix and agency,
+ * the spare capacity of the vectors, and all the separate
+ * string allocations are freed.
+ *
+ * @param isbn   in  Tables, as built by the parser, with a packed FST.
+ *                   Freed; do not use it after this call.
+ * @param flags  in  ISBN_FINALIZE_* flags
+ * @return the finalized tables.
+ *
+ * If |isbn| has already been finalized, it is returned as it is.
+ */
+isbn_info_t *
+isbn_finalize(isbn_info_t *isbn, unsigned int flags)
+{
+    isbn_info_t *dst;
+    isbn_prefix_t *src_pfxtbl;
+    isbn_prefix_t *dst_pfxtbl;
+    char **src_agencyv;
+    char **dst_agencyv;
+    size_t npfx;
+    size_t nrng;
+    size_t nagency;
+    size_t pfx_off;
+    size_t rng_off;
+    size_t agy_off;
+    size_t fst_off;
+    size_t str_off;
+    size_t str_bytes;
+    size_t size;
+    size_t i;
+    char *arena;
+    char *sp;
+
+    if (isbn->arena_size != 0) {
+        return (isbn);
+    }
+
+    npfx = isbn->prefix_vec.len;
+    nrng = isbn->ranges_vec.len;
+    nagency = isbn->agency_vec.len;
+    src_pfxtbl = (isbn_prefix_t *)isbn->prefix_vec.base;
+    src_agencyv = (char **)isbn->agency_vec.base;
+
+    str_bytes = 0;
+    for (i = 0; i < npfx; ++i) {
+        str_bytes += strlen(src_pfxtbl[i].prefix) + 1;
+    }
+    for (i = 0; i < nagency; ++i) {
+        str_bytes += strlen(src_agencyv[i]) + 1;
+    }
+
+    pfx_off = arena_align(sizeof (isbn_info_t));
+    rng_off = arena_align(pfx_off + npfx * sizeof (isbn_prefix_t));
+    agy_off = arena_align(rng_off + nrng * sizeof (isbn_range_t));
+    fst_off = arena_align(agy_off + nagency * sizeof (char *));
+    str_off = fst_off + arena_align(fst_measure(isbn->fst));
+    size = str_off + str_bytes;
+
+    flags &= ISBN_FINALIZE_PROTECT;
+    arena = arena_alloc(size, &flags);
+
+    dst = (isbn_info_t *)arena;
+    memset(dst, 0, sizeof (isbn_info_t));
+    dst->cur_value = isbn->cur_value;
+    dst->rule_nr = isbn->rule_nr;
+    dst->prefix_nr = isbn->prefix_nr;
+    dst->new_prefix.rule_idx = UNDEF_INDEX;
+    dst->fst_builder_bytes = isbn->fst_builder_bytes;
+    dst->build_bytes = isbn->build_bytes;
+    dst->err = isbn->err;
+
+    dst->prefix_vec.base = arena + pfx_off;
+    dst->prefix_vec.len = npfx;
+    dst->prefix_vec.size = npfx;
+    dst->prefix_vec.esize = sizeof (isbn_prefix_t);
+    dst_pfxtbl = (isbn_prefix_t *)dst->prefix_vec.base;
+    memcpy(dst_pfxtbl, src_pfxtbl, npfx * sizeof (isbn_prefix_t));
+
+    dst->ranges_vec.base = arena + rng_off;
+    dst->ranges_vec.len = nrng;
+    dst->ranges_vec.size = nrng;
+    dst->ranges_vec.esize = sizeof (isbn_range_t);
+    memcpy(dst->ranges_vec.base, isbn->ranges_vec.base,
+        nrng * sizeof (isbn_range_t));
+
+    dst->agency_vec.base = arena + agy_off;
+    dst->agency_vec.len = nagency;
+    dst->agency_vec.size = nagency;
+    dst->agency_vec.esize = sizeof (char *);
+    dst_agencyv = (char **)dst->agency_vec.base;
+
+    dst->fst = (fst_t *)(arena + fst_off);
+    fst_pack(dst->fst, isbn->fst);
+
+    sp = arena + str_off;
+    for (i = 0; i < npfx; ++i) {
+        dst_pfxtbl[i].prefix = copy_str(&sp, src_pfxtbl[i].prefix);
+    }
+    for (i = 0; i < nagency; ++i) {
+        dst_agencyv[i] = copy_str(&sp, src_agencyv[i]);
+    }
+
+    dst->arena_size = size;
+    dst->arena_flags = flags;
+    isbn_info_free(isbn);
+
+    if ((flags & ISBN_FINALIZE_PROTECT)
+        && mprotect(arena, size, PROT_READ) != 0) {
+        dst->arena_flags &= ~ISBN_FINALIZE_PROTECT;
+    }
+    return (dst);
+}
+
+/**
+ * @brief Free tables, either as built by the parser, or finalized.
+ */
+void
+isbn_info_free(isbn_info_t *isbn)
+{
+    isbn_prefix_t *pfxtbl;
+    char **agencyv;
+    size_t i;
+
+    if (isbn == NULL) {
+        return;
+    }
+
+    if (isbn->arena_size != 0) {
+        if (isbn->arena_flags & ISBN_ARENA_MAPPED) {
+            munmap(isbn, isbn->arena_size);
+        }
+        else {
+            free(isbn);
+        }
+        return;
+    }
+
+    pfxtbl = (isbn_prefix_t *)isbn->prefix_vec.base;
+    for (i = 0; i < isbn->prefix_vec.len; ++i) {
+        free(pfxtbl[i].prefix);
+    }
+    agencyv = (char **)isbn->agency_vec.base;
+    for (i = 0; i < isbn->agency_vec.len; ++i) {
+        free(agencyv[i]);
+    }
+    free(isbn->prefix_vec.base);
+    free(isbn->agency_vec.base);
+    free(isbn->ranges_vec.base);
+    free(isbn->cur_prefix);
+    free(isbn->cur_agency);
+    fst_free(isbn->fst);
+
+    // |path| is part of the same allocation as the header.
+    free(isbn);
+}
@@ -0,0 +1,111 @@
+/*
+ * Filename: src/isbn-xml-to-fst/isbn-lat.c
+ * Project: isbn-hyphenate
+ * Library: isbn-xml-to-fst
+ * Brief: Sampled latency histograms for the phases of a lookup
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+    // Import constant NULL
+#include <stdint.h>
+    // Import type uint64_t
+#include <stdio.h>
+    // Import type FILE
+    // Import fflush()
+    // Import fprintf()
+#include <stdlib.h>
+    // Import free()
+
+#include <cscript.h>
+#include <isbn-lat.h>
+#include <lat-hist.h>
+
+static const char *phase_namev[ISBN_LAT_NPHASES] = {
+    "prefix",
+    "range",
+    "hyphens",
+    "read",
+    "write",
+};
+
+/**
+ * @brief Create an empty set of phase histograms.
+ *
+ * @param sample_every  in  Time one call in this many.
+ *                          Rounded up to a power of 2; 0 means 1.
+ */
+isbn_lat_t *
+isbn_lat_new(unsigned int sample_every)
+{
+    isbn_lat_t *lat;
+    uint64_t n;
+    int i;
+
+    lat = (isbn_lat_t *)guard_malloc(sizeof (isbn_lat_t));
+    for (n = 1; n < sample_every; n <<= 1) {
+    }
+    for (i = 0; i < ISBN_LAT_NSITES; ++i) {
+        lat->tickv[i] = 0;
+    }
+    lat->sample_mask = n - 1;
+    for (i = 0; i < ISBN_LAT_NPHASES; ++i) {
+        lat_hist_init(&lat->histv[i], phase_namev[i]);
+    }
+    return (lat);
+}
+
+void
+isbn_lat_free(isbn_lat_t *lat)
+{
+    if (lat == NULL) {
+        return;
+    }
+    if (isbn_lat_current == lat) {
+        isbn_lat_current = NULL;
+    }
+    free(lat);
+}
+
+void
+isbn_lat_merge(isbn_lat_t *dst, const isbn_lat_t *src)
+{
+    int i;
+
+    for (i = 0; i < ISBN_LAT_NPHASES; ++i) {
+        lat_hist_merge(&dst->histv[i], &src->histv[i]);
+    }
+}
+
+/**
+ * @brief Dump all phase histograms, in the format of fdump_lat_hist().
+ *
+ * Counts are of sampled calls only; they are not scaled up.
+ */
+void
+fdump_isbn_lat(FILE *f, const isbn_lat_t *lat)
+{
+    int i;
+
+    fprintf(f, "# latency (ns), 1 in %llu calls sampled\n",
+        (unsigned long long)lat->sample_mask + 1);
+    for (i = 0; i < ISBN_LAT_NPHASES; ++i) {
+        fdump_lat_hist(f, &lat->histv[i]);
+    }
+    fflush(f);
+}
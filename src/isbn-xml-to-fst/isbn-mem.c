@@ -0,0 +1,140 @@
+/*
+ * Filename: src/isbn-xml-to-fst/isbn-mem.c
+ * Project: isbn-hyphenate
+ * Library: isbn-xml-to-fst
+ * Brief: Account for the memory held by the range tables and the FST
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <stddef.h>
+    // Import constant NULL
+#include <stdio.h>
+    // Import type FILE
+    // Import fprintf()
+#include <string.h>
+    // Import memset()
+    // Import strlen()
+#include <unistd.h>
+    // Import type size_t
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+    // Import mallinfo2()
+#define HAVE_MALLINFO2 1
+#endif
+
+#include <isbn-info.h>
+#include <libfst.h>
+
+static inline size_t
+zstr_bytes(const char *s)
+{
+    return (s == NULL ? 0 : strlen(s) + 1);
+}
+
+/**
+ * @brief Measure the heap held by each part of |isbn|.
+ *
+ * @param isbn  in   Range tables, as returned by parse_isbn_range_table()
+ * @param mem   out  Bytes, by structure
+ */
+void
+isbn_mem_usage(isbn_info_t *isbn, isbn_mem_t *mem)
+{
+    isbn_prefix_t *pfxtbl;
+    char **agencyv;
+    size_t i;
+
+    memset(mem, 0, sizeof (isbn_mem_t));
+    mem->info = sizeof (isbn_info_t);
+    if (isbn->path != NULL) {
+        mem->xml_path = XML_MAX_DEPTH * sizeof (char *);
+    }
+
+    mem->prefix_vec = isbn->prefix_vec.size * isbn->prefix_vec.esize;
+    mem->prefix_vec_used = isbn->prefix_vec.len * isbn->prefix_vec.esize;
+    mem->ranges_vec = isbn->ranges_vec.size * isbn->ranges_vec.esize;
+    mem->ranges_vec_used = isbn->ranges_vec.len * isbn->ranges_vec.esize;
+    mem->agency_vec = isbn->agency_vec.size * isbn->agency_vec.esize;
+    mem->agency_vec_used = isbn->agency_vec.len * isbn->agency_vec.esize;
+
+    pfxtbl = (isbn_prefix_t *)isbn->prefix_vec.base;
+    for (i = 0; i < isbn->prefix_vec.len; ++i) {
+        mem->prefix_strings += zstr_bytes(pfxtbl[i].prefix);
+    }
+    agencyv = (char **)isbn->agency_vec.base;
+    for (i = 0; i < isbn->agency_vec.len; ++i) {
+        mem->agency_strings += zstr_bytes(agencyv[i]);
+    }
+    mem->parse_strings = zstr_bytes(isbn->cur_prefix) + zstr_bytes(isbn->cur_agency);
+
+    if (isbn->fst != NULL) {
+        mem->fst = fst_mem_bytes(isbn->fst);
+    }
+    mem->fst_builder = isbn->fst_builder_bytes;
+    mem->build_total = isbn->build_bytes;
+    mem->arena = isbn->arena_size;
+    mem->arena_flags = isbn->arena_flags;
+
+    mem->total = mem->info + mem->xml_path
+        + mem->prefix_vec + mem->ranges_vec + mem->agency_vec
+        + mem->prefix_strings + mem->agency_strings + mem->parse_strings
+        + mem->fst;
+
+#ifdef HAVE_MALLINFO2
+    mem->heap_in_use = mallinfo2().uordblks;
+#endif
+}
+
+/**
+ * @brief Print a memory report, one "name bytes" pair per line.
+ *
+ * The two totals are for now, and for how it was at the end of
+ * parsing, when the FST was still a mass of small allocations,
+ * and the tables still had their spare capacity.
+ */
+void
+fprint_isbn_mem(FILE *f, const isbn_mem_t *mem)
+{
+    fprintf(f, "%-24s %10zu\n", "info", mem->info);
+    fprintf(f, "%-24s %10zu\n", "xml_path", mem->xml_path);
+    fprintf(f, "%-24s %10zu  (used %zu)\n", "prefix_vec",
+        mem->prefix_vec, mem->prefix_vec_used);
+    fprintf(f, "%-24s %10zu  (used %zu)\n", "ranges_vec",
+        mem->ranges_vec, mem->ranges_vec_used);
+    fprintf(f, "%-24s %10zu  (used %zu)\n", "agency_vec",
+        mem->agency_vec, mem->agency_vec_used);
+    fprintf(f, "%-24s %10zu\n", "prefix_strings", mem->prefix_strings);
+    fprintf(f, "%-24s %10zu\n", "agency_strings", mem->agency_strings);
+    fprintf(f, "%-24s %10zu\n", "parse_strings", mem->parse_strings);
+    fprintf(f, "%-24s %10zu\n", "fst", mem->fst);
+    fprintf(f, "%-24s %10zu\n", "total", mem->total);
+    if (mem->arena != 0) {
+        fprintf(f, "%-24s %10zu  (%s)\n", "arena", mem->arena,
+            (mem->arena_flags & ISBN_FINALIZE_PROTECT) ? "read-only" : "heap");
+    }
+    fprintf(f, "%-24s %10zu\n", "fst_before_pack", mem->fst_builder);
+    fprintf(f, "%-24s %10zu\n", "total_before_finalize", mem->build_total);
+    if (mem->heap_in_use != 0) {
+        fprintf(f, "%-24s %10zu\n", "heap_in_use", mem->heap_in_use);
+    }
+}
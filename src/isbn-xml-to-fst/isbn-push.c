@@ -0,0 +1,153 @@
+/*
+ * Filename: src/isbn-xml-to-fst/isbn-push.c
+ * Project: isbn-hyphenate
+ * Library: isbn-xml-to-fst
+ * Brief: Push-style hyphenation of records that arrive in arbitrary chunks
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+    // Import constant NULL
+#include <stdlib.h>
+    // Import free()
+#include <string.h>
+    // Import memchr()
+    // Import memcpy()
+#include <unistd.h>
+    // Import type size_t
+
+#include <cscript.h>
+#include <isbn-info.h>
+#include <isbn-push.h>
+
+/**
+ * @brief Make a context for feeding records to the hyphenator.
+ *
+ * @param isbn   in  Tables, as returned by parse_isbn_range_table()
+ * @param delim  in  Record delimiter; any byte, including '\0'
+ * @param fn     in  Called once for every complete record
+ * @param arg    in  Passed through to |fn|
+ */
+isbn_push_t *
+isbn_push_new(isbn_info_t *isbn, int delim, isbn_push_fn_t *fn, void *arg)
+{
+    isbn_push_t *push;
+
+    push = (isbn_push_t *)guard_calloc(1, sizeof (isbn_push_t));
+    push->isbn = isbn;
+    push->fn = fn;
+    push->arg = arg;
+    push->delim = delim;
+    return (push);
+}
+
+void
+isbn_push_free(isbn_push_t *push)
+{
+    if (push == NULL) {
+        return;
+    }
+    free(push->tail);
+    free(push);
+}
+
+/*
+ * Look up one record, and hand it to the callback.
+ *
+ * |rec| need not be NUL-terminated.  isbn_check_and_lookup() reads
+ * past |len| only once it knows there are exactly 13 digits, and
+ * then it reads no more than those 13.
+ */
+static inline void
+push_record(isbn_push_t *push, const char *rec, size_t len)
+{
+    isbn_lookup_t res;
+    int rv;
+
+    rv = isbn_check_and_lookup(push->isbn, rec, len, &res);
+    ++push->nrecords;
+    (*push->fn)(push->arg, rec, len, rv, &res);
+}
+
+static void
+tail_append(isbn_push_t *push, const char *buf, size_t n)
+{
+    size_t size;
+
+    if (push->tail_len + n > push->tail_size) {
+        size = push->tail_size ? push->tail_size : 64;
+        while (size < push->tail_len + n) {
+            size *= 2;
+        }
+        push->tail = (char *)guard_realloc(push->tail, size);
+        push->tail_size = size;
+    }
+    memcpy(push->tail + push->tail_len, buf, n);
+    push->tail_len += n;
+}
+
+/**
+ * @brief Hand over the next |n| bytes of input.
+ *
+ * Every record that this chunk completes is looked up, and passed
+ * to the callback, before this returns.  The chunk may end anywhere,
+ * even in the middle of a record; it is not needed after this returns.
+ */
+void
+isbn_push_feed(isbn_push_t *push, const void *buf, size_t n)
+{
+    const char *p = (const char *)buf;
+    const char *end = p + n;
+    const char *q;
+
+    if (push->tail_len != 0) {
+        // Finish the record that an earlier chunk started.
+        q = (const char *)memchr(p, push->delim, n);
+        if (q == NULL) {
+            tail_append(push, p, n);
+            return;
+        }
+        tail_append(push, p, q - p);
+        push_record(push, push->tail, push->tail_len);
+        push->tail_len = 0;
+        p = q + 1;
+    }
+
+    while (p < end) {
+        q = (const char *)memchr(p, push->delim, end - p);
+        if (q == NULL) {
+            tail_append(push, p, end - p);
+            return;
+        }
+        push_record(push, p, q - p);
+        p = q + 1;
+    }
+}
+
+/**
+ * @brief End of input.  Hand a last record that has no delimiter
+ * to the callback, if there is one.
+ */
+void
+isbn_push_finish(isbn_push_t *push)
+{
+    if (push->tail_len != 0) {
+        push_record(push, push->tail, push->tail_len);
+        push->tail_len = 0;
+    }
+}
@@ -0,0 +1,211 @@
+/*
+ * Filename: src/isbn-xml-to-fst/isbn-stats.c
+ * Project: isbn-hyphenate
+ * Library: isbn-xml-to-fst
+ * Brief: Counters for a stream of ISBN lookups
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+    // Import type bool
+#include <stddef.h>
+    // Import constant NULL
+#include <stdint.h>
+    // Import type uint64_t
+#include <stdio.h>
+    // Import type FILE
+    // Import fflush()
+    // Import fprintf()
+    // Import fputc()
+    // Import fputs()
+#include <stdlib.h>
+    // Import free()
+#include <string.h>
+    // Import memset()
+#include <unistd.h>
+    // Import type size_t
+
+#include <cscript.h>
+#include <isbn-info.h>
+#include <isbn-stats.h>
+
+/**
+ * @brief Create a set of counters, all zero.
+ *
+ * @param isbn  in  Range table; sizes the per-group counters.
+ *                  May be NULL, for no per-group counts.
+ */
+isbn_stats_t *
+isbn_stats_new(isbn_info_t *isbn)
+{
+    isbn_stats_t *stats;
+
+    stats = (isbn_stats_t *)guard_malloc(sizeof (isbn_stats_t));
+    memset(stats, 0, sizeof (isbn_stats_t));
+    if (isbn != NULL && isbn->prefix_vec.len != 0) {
+        stats->ngroups = isbn->prefix_vec.len;
+        stats->group_ok = (uint64_t *)guard_calloc(stats->ngroups, sizeof (uint64_t));
+        stats->group_err_range = (uint64_t *)guard_calloc(stats->ngroups, sizeof (uint64_t));
+    }
+    return (stats);
+}
+
+void
+isbn_stats_free(isbn_stats_t *stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+    free(stats->group_ok);
+    free(stats->group_err_range);
+    free(stats);
+}
+
+/**
+ * @brief Add the counters of |src| into |dst|.
+ *
+ * Both must have been made for the same range table.
+ */
+void
+isbn_stats_merge(isbn_stats_t *dst, const isbn_stats_t *src)
+{
+    size_t i;
+
+    dst->lines      += src->lines;
+    dst->lookups    += src->lookups;
+    dst->ok         += src->ok;
+    dst->err_length += src->err_length;
+    dst->err_check  += src->err_check;
+    dst->err_prefix += src->err_prefix;
+    dst->err_range  += src->err_range;
+    dst->err_other  += src->err_other;
+    dst->bytes_in   += src->bytes_in;
+    dst->bytes_out  += src->bytes_out;
+    dst->ns_parse   += src->ns_parse;
+    dst->ns_lookup  += src->ns_lookup;
+    dst->ns_output  += src->ns_output;
+    for (i = 0; i < dst->ngroups && i < src->ngroups; ++i) {
+        dst->group_ok[i] += src->group_ok[i];
+        dst->group_err_range[i] += src->group_err_range[i];
+    }
+}
+
+static void
+fprint_stats_text(FILE *f, const isbn_stats_t *stats, isbn_info_t *isbn)
+{
+    isbn_prefix_t *pfxtbl;
+    size_t i;
+
+    fprintf(f, "lines:       %llu\n", (unsigned long long)stats->lines);
+    fprintf(f, "lookups:     %llu\n", (unsigned long long)stats->lookups);
+    fprintf(f, "ok:          %llu\n", (unsigned long long)stats->ok);
+    fprintf(f, "err_length:  %llu\n", (unsigned long long)stats->err_length);
+    fprintf(f, "err_check:   %llu\n", (unsigned long long)stats->err_check);
+    fprintf(f, "err_prefix:  %llu\n", (unsigned long long)stats->err_prefix);
+    fprintf(f, "err_range:   %llu\n", (unsigned long long)stats->err_range);
+    fprintf(f, "err_other:   %llu\n", (unsigned long long)stats->err_other);
+    fprintf(f, "bytes_in:    %llu\n", (unsigned long long)stats->bytes_in);
+    fprintf(f, "bytes_out:   %llu\n", (unsigned long long)stats->bytes_out);
+    fprintf(f, "sec_parse:   %.6f\n", stats->ns_parse / 1e9);
+    fprintf(f, "sec_lookup:  %.6f\n", stats->ns_lookup / 1e9);
+    fprintf(f, "sec_output:  %.6f\n", stats->ns_output / 1e9);
+
+    if (isbn == NULL || stats->ngroups == 0) {
+        return;
+    }
+    pfxtbl = (isbn_prefix_t *)isbn->prefix_vec.base;
+    fprintf(f, "groups:\n");
+    for (i = 0; i < stats->ngroups; ++i) {
+        if (stats->group_ok[i] == 0 && stats->group_err_range[i] == 0) {
+            continue;
+        }
+        fprintf(f, "    %-10s ok=%llu err_range=%llu  %s\n",
+            pfxtbl[i].prefix,
+            (unsigned long long)stats->group_ok[i],
+            (unsigned long long)stats->group_err_range[i],
+            isbn_agency_name(isbn, pfxtbl[i].agency_id));
+    }
+}
+
+static void
+fprint_stats_json(FILE *f, const isbn_stats_t *stats, isbn_info_t *isbn)
+{
+    isbn_prefix_t *pfxtbl;
+    const char *sep;
+    size_t i;
+
+    fprintf(f, "{\"lines\":%llu,\"lookups\":%llu,\"ok\":%llu,"
+        "\"err_length\":%llu,\"err_check\":%llu,"
+        "\"err_prefix\":%llu,\"err_range\":%llu,\"err_other\":%llu,"
+        "\"bytes_in\":%llu,\"bytes_out\":%llu,"
+        "\"sec_parse\":%.6f,\"sec_lookup\":%.6f,\"sec_output\":%.6f",
+        (unsigned long long)stats->lines,
+        (unsigned long long)stats->lookups,
+        (unsigned long long)stats->ok,
+        (unsigned long long)stats->err_length,
+        (unsigned long long)stats->err_check,
+        (unsigned long long)stats->err_prefix,
+        (unsigned long long)stats->err_range,
+        (unsigned long long)stats->err_other,
+        (unsigned long long)stats->bytes_in,
+        (unsigned long long)stats->bytes_out,
+        stats->ns_parse / 1e9,
+        stats->ns_lookup / 1e9,
+        stats->ns_output / 1e9);
+
+    if (isbn != NULL && stats->ngroups != 0) {
+        pfxtbl = (isbn_prefix_t *)isbn->prefix_vec.base;
+        fputs(",\"groups\":[", f);
+        sep = "";
+        for (i = 0; i < stats->ngroups; ++i) {
+            if (stats->group_ok[i] == 0 && stats->group_err_range[i] == 0) {
+                continue;
+            }
+            fprintf(f, "%s{\"prefix\":\"%s\",\"agency\":", sep, pfxtbl[i].prefix);
+            fputs_json(f, isbn_agency_name(isbn, pfxtbl[i].agency_id));
+            fprintf(f, ",\"ok\":%llu,\"err_range\":%llu}",
+                (unsigned long long)stats->group_ok[i],
+                (unsigned long long)stats->group_err_range[i]);
+            sep = ",";
+        }
+        fputc(']', f);
+    }
+    fputs("}\n", f);
+}
+
+/**
+ * @brief Print counters, as text for people, or as one line of JSON.
+ *
+ * @param f      in  Where to print
+ * @param stats  in  Counters
+ * @param isbn   in  Range table, for the names of groups; may be NULL.
+ * @param json   in  JSON, instead of text
+ *
+ * Only groups with at least one hit are listed.
+ */
+void
+fprint_isbn_stats(FILE *f, const isbn_stats_t *stats, isbn_info_t *isbn, bool json)
+{
+    if (json) {
+        fprint_stats_json(f, stats, isbn);
+    }
+    else {
+        fprint_stats_text(f, stats, isbn);
+    }
+    fflush(f);
+}
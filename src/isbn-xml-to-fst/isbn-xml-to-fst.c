@@ -59,6 +59,7 @@
 #include <cscript.h>
 #include <fprint.h>
 #include <isbn-info.h>
+#include <isbn-lat.h>
 #include <libfst.h>
 #include <vec.h>
 
@@ -77,9 +78,10 @@ new_isbn_info(void)
     size_t tsize = sizeof (isbn_info_t) + XML_MAX_DEPTH * sizeof (char *);
     isbn_info_t *isbn = (isbn_info_t *)guard_malloc(tsize);
     memset((void *)isbn, 0, sizeof (isbn_info_t));
-    isbn->path = (char **)isbn + sizeof (isbn_info_t);
+    isbn->path = (char **)((char *)isbn + sizeof (isbn_info_t));
     isbn->prefix_vec.esize = sizeof (isbn_prefix_t);
     isbn->ranges_vec.esize = sizeof (isbn_range_t);
+    isbn->agency_vec.esize = sizeof (char *);
     isbn->fst = fst_new();
     return (isbn);
 }
@@ -87,14 +89,14 @@ new_isbn_info(void)
 // #################### Path functions
 
 void
-fdump_prefix_table(FILE *f, vec_t *prefix_vp)
+fdump_prefix_table(FILE *f, isbn_info_t *isbn)
 {
     isbn_prefix_t *pfxtbl;
     size_t n;
     size_t i;
 
-    pfxtbl = prefix_vp->base;
-    n = prefix_vp->len;
+    pfxtbl = isbn->prefix_vec.base;
+    n = isbn->prefix_vec.len;
     fprintl(f, "");
     fprintl(f,"@section prefix-table");
     fprintf(f, "Prefix table: %zu entries.", n);
@@ -103,7 +105,7 @@ fdump_prefix_table(FILE *f, vec_t *prefix_vp)
         fprintf(f, "[%3zu] pfx=[%s], agency=[%s], rules={%zu,%zu}",
                 i,
                 pfxtbl[i].prefix,
-                pfxtbl[i].agency,
+                isbn_agency_name(isbn, pfxtbl[i].agency_id),
                 pfxtbl[i].rule_idx,
                 pfxtbl[i].nrules);
         fprintl(f, "");
@@ -168,6 +170,36 @@ fprint_path(FILE *f, isbn_info_t *isbn)
 
 // #################### Functions to build Rules data structures
 
+/*
+ * Return the agency id for |agency|, adding it to |agency_vec|
+ * if it has not been seen before.  Return ISBN_AGENCY_MAX
+ * if the table is full.
+ *
+ * There are a few hundred agencies, and this is done once per
+ * registration group, at load time, so a linear search will do.
+ */
+static size_t
+intern_agency(isbn_info_t *isbn, const char *agency)
+{
+    char **agencyv;
+    size_t id;
+
+    agencyv = isbn->agency_vec.base;
+    for (id = 0; id < isbn->agency_vec.len; ++id) {
+        if (strcmp(agencyv[id], agency) == 0) {
+            return (id);
+        }
+    }
+    if (id >= ISBN_AGENCY_MAX) {
+        return (ISBN_AGENCY_MAX);
+    }
+    vec_make_room(&isbn->agency_vec, id);
+    agencyv = isbn->agency_vec.base;
+    agencyv[id] = strdup(agency);
+    ++isbn->agency_vec.len;
+    return (id);
+}
+
 int
 add_prefix(isbn_info_t *isbn, char *pfx, char *agency)
 {
@@ -175,9 +207,16 @@ add_prefix(isbn_info_t *isbn, char *pfx, char *agency)
     char numeric_prefix[16];
     size_t rlen;
     size_t i;
+    size_t agency_id;
     val_t prefix_val;
     int rc;
 
+    agency_id = intern_agency(isbn, agency);
+    if (agency_id >= ISBN_AGENCY_MAX) {
+        eprintl("Too many agencies.");
+        return (2);
+    }
+
     vec_make_room(&isbn->prefix_vec, isbn->prefix_nr);
     pfxtbl = isbn->prefix_vec.base;
 
@@ -195,7 +234,7 @@ add_prefix(isbn_info_t *isbn, char *pfx, char *agency)
     numeric_prefix[rlen] = '\0';
 
     isbn->new_prefix.prefix = strdup(numeric_prefix);
-    isbn->new_prefix.agency = strdup(agency);  // XXX Use str_intern()
+    isbn->new_prefix.agency_id = (uint16_t)agency_id;
 
     // These fields have been set by add_rule()
     //     .rule_idx
@@ -492,6 +531,10 @@ parseDoc(isbn_info_t *isbn, const char *docname)
 
 // #################### Hyphenate a 13-digit ISBN
 
+static const uint32_t pow10_u32[8] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000
+};
+
 uint32_t
 parse_number_slice(const char *s, size_t len)
 {
@@ -534,12 +577,13 @@ parse_number_slice(const char *s, size_t len)
  * 0123456789012
  *     0123456
  *     |
- * These 7 digits are what is compared to entries in the range table.
- * Although the prefix is variable-length, and the dividing line
- * between { Group - Registrant - Publication } varies,
- * the combination of these 3 fields always starts at offset 4,
- * and is 7 digits long, and the range table entries tell how
- * these 3 fields are to be split.
+ * The range table entries for a prefix are compared against
+ * the 7 digits that follow the prefix (EAN.UCC prefix + Registration Group).
+ * For a 1-digit group, as shown above, that is offset 4 through 10.
+ * For longer groups, the 7 digits start later, and fewer than 7 digits
+ * remain before the check digit; those are padded on the right
+ * with zeros.  The range table entries tell how the remaining digits
+ * are to be split between { Registrant - Publication }.
  *
  * Using range tables allows for splitting Registration Groups
  * into more fine-grain pieces that could be achieved using more
@@ -588,14 +632,89 @@ place_hyphens(
     memcpy(hbuf + lbuf, isbn + 3 + l1, len);  // Registrant
     lbuf += len;
     hbuf[lbuf++] = '-';
-    memcpy(hbuf + lbuf, isbn + 3 + l1 + len, 8 - len); // Publication
-    lbuf += 8 - len;
+    memcpy(hbuf + lbuf, isbn + 3 + l1 + len, 9 - l1 - len); // Publication
+    lbuf += 9 - l1 - len;
     hbuf[lbuf++] = '-';
     memcpy(hbuf + lbuf, isbn + 12, 1); // Check-digit
     ++lbuf;
     hbuf[lbuf] = '\0';
 }
 
+/*
+ * Find the range table entry, among those for prefix |pfx|,
+ * that contains |registrant|, and return its length,
+ * and, if |rule_nr_ref| is not NULL, its index in |ranges_vec|.
+ * A range with length 0 is not (yet) assigned, and does not match.
+ *
+ * @return  0 for success, ERANGE if no assigned range matches.
+ */
+
+static inline int
+isbn_find_range(
+  isbn_info_t *isbn,
+  isbn_prefix_t *pfx,
+  uint32_t registrant,
+  size_t *len_ref,
+  size_t *rule_nr_ref)
+{
+    isbn_range_t *ranges_rule;
+    size_t n;
+    size_t i;
+
+    ranges_rule = (isbn_range_t *)isbn->ranges_vec.base + pfx->rule_idx;
+    n = pfx->nrules;
+
+    // Linear search for the registrant in range table for this agency
+
+    for (i = 0; i < n; ++i) {
+        uint32_t lo = ranges_rule[i].rng_lbound;
+        uint32_t hi = ranges_rule[i].rng_ubound;
+
+        if (registrant >= lo && registrant <= hi) {
+            if (ranges_rule[i].rng_len == 0) {
+                return (ERANGE);
+            }
+            *len_ref = ranges_rule[i].rng_len;
+            if (rule_nr_ref != NULL) {
+                *rule_nr_ref = pfx->rule_idx + i;
+            }
+            return (0);
+        }
+    }
+
+    return (ERANGE);
+}
+
+/*
+ * The 7 digits, following a prefix of length |pfxlen|,
+ * that get compared against the range table.
+ * See "Anatomy of an ISBN", above.
+ */
+
+static inline uint32_t
+registrant_from_str(const char *isbn_str, size_t pfxlen)
+{
+    size_t avail = 12 - pfxlen;
+
+    if (avail >= 7) {
+        return (parse_number_slice(isbn_str + pfxlen, 7));
+    }
+    return (parse_number_slice(isbn_str + pfxlen, avail) * pow10_u32[7 - avail]);
+}
+
+static inline uint32_t
+registrant_from_u64(uint64_t isbn13, size_t pfxlen)
+{
+    size_t avail = 12 - pfxlen;
+
+    // Drop the check digit, and any digits after the 7 we want.
+    isbn13 /= 10;
+    if (avail >= 7) {
+        return ((uint32_t)((isbn13 / pow10_u32[avail - 7]) % 10000000));
+    }
+    return ((uint32_t)(isbn13 % pow10_u32[avail]) * pow10_u32[7 - avail]);
+}
+
 /*
  * Figure out how to hyphenate a pure numeric 13-digit ISBN.
  * Find the correct prefix.
@@ -615,8 +734,16 @@ place_hyphens(
  * @param   isbn     in   The pure numeric ISBN-13 to be hyphenated (zstring).
  *
  * @return  0 for success, non-zero for error codes.
+ *          ENOENT if no registration group (prefix) matches.
+ *          ERANGE if the group matches, but none of its assigned ranges do.
  */
 
+/*
+ * The calling thread's latency histograms, if sampling is on.
+ * See isbn-lat.h.
+ */
+__thread isbn_lat_t *isbn_lat_current = NULL;
+
 int
 hyphenate_isbn(
   isbn_info_t *isbn,
@@ -624,10 +751,37 @@ hyphenate_isbn(
   size_t bsz,
   const char *isbn_str)
 {
+    return (hyphenate_isbn_ex(isbn, hbuf, bsz, isbn_str, NULL));
+}
+
+/*
+ * Same as hyphenate_isbn(), but also tell which registration group
+ * the ISBN-13 belongs to.
+ *
+ * @param   prefix_nr  out  Index into |prefix_vec| of the matching
+ *                          prefix, or UNDEF_INDEX if none matched.
+ *                          Set on success, and on ERANGE.
+ *                          May be NULL.
+ */
+
+int
+hyphenate_isbn_ex(
+  isbn_info_t *isbn,
+  char *hbuf,
+  size_t bsz,
+  const char *isbn_str,
+  size_t *prefix_nr)
+{
+    isbn_lat_t *lat;
+    uint64_t t = 0;
     fst_t *fst;
-    size_t val;
+    size_t val = 0;
     int rc;
 
+    if (prefix_nr != NULL) {
+        *prefix_nr = UNDEF_INDEX;
+    }
+
     if (isbn == NULL) {
         return (ENODATA);
     }
@@ -643,7 +797,9 @@ hyphenate_isbn(
         return (ENOSPC);
     }
 
+    lat = isbn_lat_sample(ISBN_LAT_SITE_LOOKUP, &t);
     rc = fst_lookup_prefix(fst, isbn_str, &val);
+    isbn_lat_phase(lat, ISBN_LAT_PREFIX, &t);
     if (rc) {
         if (verbose) {
             fprintf(vprint_fh, "Lookup of ('%s') failed; rc = %d.", isbn_str, rc);
@@ -655,11 +811,16 @@ hyphenate_isbn(
     isbn_prefix_t *prefix_tbl = isbn->prefix_vec.base;
     isbn_prefix_t *pfx = prefix_tbl + val;
 
+    if (prefix_nr != NULL) {
+        *prefix_nr = val;
+    }
+
     if (verbose) {
         fprintf(vprint_fh, "isbn %s -> prefix=%zu='%s'",
                 isbn_str, val, pfx->prefix);
         fprintl(vprint_fh, "");
-        fprintf(vprint_fh, "Agency='%s'", pfx->agency);
+        fprintf(vprint_fh, "Agency='%s'",
+            isbn_agency_name(isbn, pfx->agency_id));
         fprintl(vprint_fh, "");
     }
 
@@ -667,12 +828,13 @@ hyphenate_isbn(
     isbn_range_t *ranges_rule;
     size_t pfxlen;
     size_t n;
+    size_t len;
 
     pfxlen = strlen(pfx->prefix);
     ranges_base = isbn->ranges_vec.base;
     ranges_rule = ranges_base + pfx->rule_idx;
     n = pfx->nrules;
-    uint32_t registrant = parse_number_slice(isbn_str + 4, 7);
+    uint32_t registrant = registrant_from_str(isbn_str, pfxlen);
 
     if (verbose) {
         // Show range table entries for this agency,
@@ -694,36 +856,472 @@ hyphenate_isbn(
         }
     }
 
-    // Linear search for the registrant in range table for this agency
+    if (lat != NULL && verbose) {
+        // Do not charge the verbose output to the range search.
+        t = isbn_lat_now();
+    }
+    rc = isbn_find_range(isbn, pfx, registrant, &len, NULL);
+    isbn_lat_phase(lat, ISBN_LAT_RANGE, &t);
+    if (rc) {
+        return (rc);
+    }
+    place_hyphens(hbuf, bsz, isbn_str, len, pfx->prefix, pfxlen);
+    isbn_lat_phase(lat, ISBN_LAT_HYPHENS, &t);
+    return (0);
+}
+
+/*
+ * Find the registration group and the range of a numeric ISBN-13.
+ *
+ * The prefix lookup and range search work directly on the decimal
+ * digits of |isbn13|, extracted arithmetically.
+ *
+ * @param   pfx_ref    out  The matching prefix; set on success,
+ *                          and on ERANGE.
+ * @param   len_ref    out  Length of the registrant element.
+ * @return  0 for success, non-zero for error codes,
+ *          as for hyphenate_isbn().
+ *          EINVAL if |isbn13| has more than 13 digits.
+ */
+
+static inline int
+isbn_find_u64(
+  isbn_info_t *isbn,
+  uint64_t isbn13,
+  isbn_prefix_t **pfx_ref,
+  size_t *len_ref)
+{
+    isbn_prefix_t *pfx;
+    val_t val;
+    int rc;
+
+    if (isbn == NULL || isbn->fst == NULL) {
+        return (ENODATA);
+    }
+
+    if (isbn13 >= 10000000000000ULL) {
+        return (EINVAL);
+    }
+
+    rc = fst_lookup_prefix_u64(isbn->fst, isbn13, 13, &val);
+    if (rc) {
+        return (rc);
+    }
+
+    pfx = (isbn_prefix_t *)isbn->prefix_vec.base + val;
+    *pfx_ref = pfx;
+    return (isbn_find_range(isbn, pfx,
+        registrant_from_u64(isbn13, strlen(pfx->prefix)), len_ref, NULL));
+}
+
+/*
+ * Same as hyphenate_isbn(), but the ISBN-13 is given as a number.
+ * The only conversion to text is the one needed to write
+ * the hyphenated result.
+ *
+ * @return  0 for success, non-zero for error codes,
+ *          as for hyphenate_isbn().
+ *          EINVAL if |isbn13| has more than 13 digits.
+ */
+
+int
+hyphenate_isbn_u64(
+  isbn_info_t *isbn,
+  char *hbuf,
+  size_t bsz,
+  uint64_t isbn13)
+{
+    isbn_prefix_t *pfx;
+    char digits[14];
+    size_t len;
+    uint64_t n;
+    int rc;
+    int i;
+
+    // Need space for ISBN-13 + 4 hyphens + nul-byte
+    if (bsz < 18) {
+        return (ENOSPC);
+    }
+
+    rc = isbn_find_u64(isbn, isbn13, &pfx, &len);
+    if (rc) {
+        return (rc);
+    }
+
+    n = isbn13;
+    for (i = 12; i >= 0; --i) {
+        digits[i] = '0' + (char)(n % 10);
+        n /= 10;
+    }
+    digits[13] = '\0';
+    place_hyphens(hbuf, bsz, digits, len, pfx->prefix, strlen(pfx->prefix));
+    return (0);
+}
+
+/*
+ * Same as hyphenate_isbn_u64(), but, instead of writing the hyphenated
+ * ISBN-13, tell where the hyphens go, packed into 16 bits;
+ * see ISBN_HYPHENS_POS().  No text is read or written.
+ *
+ * @param   hyphens_ref  out  Hyphen positions; 0 on failure.
+ * @param   prefix_nr    out  As for hyphenate_isbn_ex().  May be NULL.
+ * @return  0 for success, non-zero for error codes,
+ *          as for hyphenate_isbn_u64().
+ */
+
+int
+isbn_hyphens_u64(
+  isbn_info_t *isbn,
+  uint64_t isbn13,
+  uint16_t *hyphens_ref,
+  size_t *prefix_nr)
+{
+    isbn_prefix_t *pfx = NULL;
+    size_t pfxlen;
+    size_t len;
+    int rc;
+
+    *hyphens_ref = 0;
+    rc = isbn_find_u64(isbn, isbn13, &pfx, &len);
+    if (prefix_nr != NULL) {
+        *prefix_nr = pfx == NULL ? UNDEF_INDEX
+            : (size_t)(pfx - (isbn_prefix_t *)isbn->prefix_vec.base);
+    }
+    if (rc) {
+        return (rc);
+    }
+
+    pfxlen = strlen(pfx->prefix);
+    *hyphens_ref = (uint16_t)((3 << 12) | (pfxlen << 8)
+        | ((pfxlen + len) << 4) | 12);
+    return (0);
+}
 
+/*
+ * Same as isbn_hyphens_u64(), but return the ISBN-13 and the lengths
+ * of its group and registrant elements, packed into one uint64_t;
+ * see isbn_packed_make().  That is all it takes to hyphenate it
+ * again, later, without the tables; see isbn_unpack().
+ *
+ * @param   packed_ref   out  On failure, |isbn13|, with both lengths 0.
+ * @param   prefix_nr    out  As for hyphenate_isbn_ex().  May be NULL.
+ * @return  0 for success, non-zero for error codes,
+ *          as for hyphenate_isbn_u64().
+ */
+
+int
+isbn_pack_u64(
+  isbn_info_t *isbn,
+  uint64_t isbn13,
+  uint64_t *packed_ref,
+  size_t *prefix_nr)
+{
+    isbn_prefix_t *pfx = NULL;
+    size_t len;
+    int rc;
+
+    *packed_ref = isbn13 & ISBN_PACKED_ISBN_MASK;
+    rc = isbn_find_u64(isbn, isbn13, &pfx, &len);
+    if (prefix_nr != NULL) {
+        *prefix_nr = pfx == NULL ? UNDEF_INDEX
+            : (size_t)(pfx - (isbn_prefix_t *)isbn->prefix_vec.base);
+    }
+    if (rc) {
+        return (rc);
+    }
+    *packed_ref = isbn_packed_make(isbn13, strlen(pfx->prefix) - 3, len);
+    return (0);
+}
+
+/*
+ * Write the hyphenated form of a packed ISBN-13, as made by
+ * isbn_pack_u64().  The tables are not needed.
+ *
+ * @param  hbuf   out  At least 18 bytes.
+ * @return  0, or EINVAL if |packed| does not hold hyphen positions
+ *          that leave at least one digit for the publication element,
+ *          or ENOSPC if |hbuf| is too small.
+ */
+
+int
+isbn_unpack(uint64_t packed, char *hbuf, size_t bsz)
+{
+    uint64_t n;
+    size_t glen;
+    size_t rlen;
+    size_t len;
+    char digits[13];
+    int i;
+
+    glen = ISBN_PACKED_GROUP_LEN(packed);
+    rlen = ISBN_PACKED_REGISTRANT_LEN(packed);
+    n = packed & ISBN_PACKED_ISBN_MASK;
+    if (glen == 0 || rlen == 0 || glen + rlen > 8
+        || n >= 10000000000000ULL) {
+        return (EINVAL);
+    }
+    if (bsz < 18) {
+        return (ENOSPC);
+    }
+
+    for (i = 12; i >= 0; --i) {
+        digits[i] = '0' + (char)(n % 10);
+        n /= 10;
+    }
+    len = 0;
+    for (i = 0; i < 13; ++i) {
+        hbuf[len++] = digits[i];
+        if (i == 2 || i == 2 + (int)glen || i == 2 + (int)(glen + rlen)
+            || i == 11) {
+            hbuf[len++] = '-';
+        }
+    }
+    hbuf[len] = '\0';
+    return (0);
+}
+
+/*
+ * Look up an ISBN-13, and report everything about it that the
+ * range table knows: the elements, the agency, and which prefix
+ * and which range matched.  See isbn_lookup_t.
+ *
+ * This does the same work as hyphenate_isbn_ex(), in a single pass,
+ * but without latency sampling, and without verbose tracing.
+ *
+ * @return  0 for success, non-zero for error codes,
+ *          as for hyphenate_isbn().
+ */
+
+static inline void
+isbn_lookup_reset(isbn_lookup_t *res)
+{
+    res->prefix_nr = UNDEF_INDEX;
+    res->rule_nr = UNDEF_INDEX;
+    res->agency_id = 0;
+    res->agency = NULL;
+    res->hyphenated[0] = '\0';
+}
+
+int
+isbn_lookup(isbn_info_t *isbn, const char *isbn_str, isbn_lookup_t *res)
+{
+    isbn_prefix_t *pfx;
+    size_t pfxlen;
+    size_t len;
+    val_t val;
+    int rc;
+    int i;
+
+    isbn_lookup_reset(res);
+
+    if (isbn == NULL || isbn->fst == NULL) {
+        return (ENODATA);
+    }
+
+    rc = fst_lookup_prefix(isbn->fst, isbn_str, &val);
+    if (rc) {
+        return (rc);
+    }
+    pfx = (isbn_prefix_t *)isbn->prefix_vec.base + val;
+    res->prefix_nr = val;
+    res->agency_id = pfx->agency_id;
+    res->agency = isbn_agency_name(isbn, pfx->agency_id);
+
+    pfxlen = strlen(pfx->prefix);
+    rc = isbn_find_range(isbn, pfx, registrant_from_str(isbn_str, pfxlen),
+        &len, &res->rule_nr);
+    if (rc) {
+        return (rc);
+    }
+    place_hyphens(res->hyphenated, sizeof (res->hyphenated),
+        isbn_str, len, pfx->prefix, pfxlen);
+
+    // Element lengths, in order; each is followed by a hyphen.
+    res->elem_len[ISBN_EL_PREFIX] = 3;
+    res->elem_len[ISBN_EL_GROUP] = pfxlen - 3;
+    res->elem_len[ISBN_EL_REGISTRANT] = len;
+    res->elem_len[ISBN_EL_PUBLICATION] = 12 - pfxlen - len;
+    res->elem_len[ISBN_EL_CHECK] = 1;
+    res->elem_off[ISBN_EL_PREFIX] = 0;
+    for (i = 1; i < ISBN_NELEMENTS; ++i) {
+        res->elem_off[i] = res->elem_off[i - 1] + res->elem_len[i - 1] + 1;
+    }
+    return (0);
+}
+
+/*
+ * Check only that |isbn_str| (of length |len|) is exactly 13 decimal
+ * digits, so that it is safe to give to hyphenate_isbn(), or to
+ * isbn_lookup(), which read 13 bytes, whatever the record length.
+ * The check digit is not checked; see isbn_validate().
+ *
+ * @return  0, or EINVAL.
+ */
+
+int
+isbn_check_form(const char *isbn_str, size_t len)
+{
     size_t i;
-    for (i = 0; i < n; ++i) {
-        uint32_t lo = ranges_rule[i].rng_lbound;
-        uint32_t hi = ranges_rule[i].rng_ubound;
-        size_t len  = ranges_rule[i].rng_len;
 
-        if (registrant >= lo && registrant <= hi) {
-            place_hyphens(hbuf, bsz, isbn_str, len, pfx->prefix, pfxlen);
-            return (0);
+    if (len != 13) {
+        return (EINVAL);
+    }
+    for (i = 0; i < 13; ++i) {
+        if ((unsigned char)isbn_str[i] - '0' > 9) {
+            return (EINVAL);
+        }
+    }
+    return (0);
+}
+
+/*
+ * Check that |isbn_str| (of length |len|) is an ISBN-13:
+ * exactly 13 decimal digits, of which the last is the right
+ * check digit.  The tables are not consulted.
+ *
+ * @return  0, or EINVAL if it is not 13 digits,
+ *          or EBADMSG if the check digit is wrong.
+ */
+
+int
+isbn_validate(const char *isbn_str, size_t len)
+{
+    unsigned int sum;
+    unsigned int d;
+    size_t i;
+
+    if (len != 13) {
+        return (EINVAL);
+    }
+    sum = 0;
+    for (i = 0; i < 13; ++i) {
+        d = (unsigned char)isbn_str[i] - '0';
+        if (d > 9) {
+            return (EINVAL);
         }
+        // Weights alternate 1, 3, 1, 3, ... including the check digit,
+        // so that a correct ISBN-13 sums to a multiple of 10.
+        sum += (i & 1) ? 3 * d : d;
+    }
+    return (sum % 10 == 0 ? 0 : EBADMSG);
+}
+
+/*
+ * isbn_validate(), and then, if that passes, isbn_lookup().
+ * |res| is always reset, so it is safe to print whatever it holds.
+ */
+
+int
+isbn_check_and_lookup(isbn_info_t *isbn, const char *isbn_str, size_t len,
+    isbn_lookup_t *res)
+{
+    int rc;
+
+    rc = isbn_validate(isbn_str, len);
+    if (rc) {
+        isbn_lookup_reset(res);
+        return (rc);
+    }
+    return (isbn_lookup(isbn, isbn_str, res));
+}
+
+/*
+ * A short, fixed-width code for the outcome of a lookup:
+ *
+ *     OK   success
+ *     LEN  EINVAL   not 13 decimal digits
+ *     CHK  EBADMSG  wrong check digit
+ *     PFX  ENOENT   no registration group matches
+ *     RNG  ERANGE   the group is known, but no assigned range matches
+ *     ERR  anything else
+ */
+
+const char *
+isbn_status_code(int err)
+{
+    switch (err) {
+    case 0:       return ("OK");
+    case EINVAL:  return ("LEN");
+    case EBADMSG: return ("CHK");
+    case ENOENT:  return ("PFX");
+    case ERANGE:  return ("RNG");
+    default:      return ("ERR");
+    }
+}
+
+/*
+ * Find the agency responsible for the registration group of an ISBN-13.
+ * Only the prefix is looked up; the registrant is not checked
+ * against the range table.
+ *
+ * @param   agency_id_ref  out  Agency id; see isbn_agency_name().
+ * @return  0, or ENOENT if no registration group matches,
+ *          or ENODATA if there are no tables.
+ */
+
+int
+isbn_agency_id(isbn_info_t *isbn, const char *isbn_str,
+    uint16_t *agency_id_ref)
+{
+    isbn_prefix_t *pfx;
+    val_t val;
+    int rc;
+
+    if (isbn == NULL || isbn->fst == NULL) {
+        return (ENODATA);
+    }
+    rc = fst_lookup_prefix(isbn->fst, isbn_str, &val);
+    if (rc) {
+        return (rc);
     }
+    pfx = (isbn_prefix_t *)isbn->prefix_vec.base + val;
+    *agency_id_ref = pfx->agency_id;
+    return (0);
+}
+
+/*
+ * Same as isbn_agency_id(), but return the interned agency name,
+ * or NULL if there is none.  Nothing is copied.
+ */
 
-    return (ENOENT);
+const char *
+isbn_agency(isbn_info_t *isbn, const char *isbn_str)
+{
+    uint16_t agency_id;
+
+    if (isbn_agency_id(isbn, isbn_str, &agency_id) != 0) {
+        return (NULL);
+    }
+    return (isbn_agency_name(isbn, agency_id));
 }
 
+/**
+ * @brief Read the range table XML file, build the tables and the FST,
+ * and finalize them; see isbn_finalize().
+ *
+ * @param docname  in  Path to the XML file
+ * @param flags    in  ISBN_FINALIZE_* flags
+ */
 isbn_info_t *
-parse_isbn_range_table(const char *docname)
+parse_isbn_range_table_ex(const char *docname, unsigned int flags)
 {
     isbn_info_t *isbn;
-    fst_t *isbn_prefix_fst_builder;
+    isbn_mem_t mem;
+    fst_t *builder;
 
     isbn = new_isbn_info();
-    parseDoc(isbn, docname);
-    // XXX *result_fst = isbn_prefix_fst_builder;
-    isbn_prefix_fst_builder = isbn->fst;
-    isbn->fst = fst_copy_and_pack(isbn->fst);
+    if (parseDoc(isbn, docname) == 2) {
+        isbn_info_free(isbn);
+        return (NULL);
+    }
+    isbn_mem_usage(isbn, &mem);
+    isbn->build_bytes = mem.total;
+    builder = isbn->fst;
+    isbn->fst = fst_copy_and_pack(builder);
+    isbn->fst_builder_bytes = fst_mem_bytes(builder);
+    fst_free(builder);
     if (verbose) {
-        fdump_prefix_table(vprint_fh, &isbn->prefix_vec);
+        fdump_prefix_table(vprint_fh, isbn);
         fflush(vprint_fh);
         fprintl(vprint_fh, "");
         fprintf(vprint_fh, "@section fst -- prefix state machine");
@@ -732,5 +1330,11 @@ parse_isbn_range_table(const char *docname)
         fprintl(vprint_fh, "@end fst");
         fdump_ranges(vprint_fh, &isbn->ranges_vec);
     }
-    return (isbn);
+    return (isbn_finalize(isbn, flags));
+}
+
+isbn_info_t *
+parse_isbn_range_table(const char *docname)
+{
+    return (parse_isbn_range_table_ex(docname, 0));
 }
@@ -0,0 +1,768 @@
+/*
+ * Filename: src/libcscript/aread.c
+ * Project: libcscript
+ * Brief: Read a list of files in order, with several reads in flight
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <errno.h>
+    // Import var errno
+    // Import constant EINTR
+#include <fcntl.h>
+    // Import open()
+    // Import posix_fadvise()
+    // Import constant O_RDONLY
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stddef.h>
+    // Import constant NULL
+#include <stdint.h>
+    // Import type uint64_t
+#include <stdlib.h>
+    // Import free()
+#include <string.h>
+    // Import memset()
+#include <sys/stat.h>
+    // Import fstat()
+    // Import S_ISREG()
+#include <sys/uio.h>
+    // Import type struct iovec
+#include <unistd.h>
+    // Import close()
+    // Import lseek()
+    // Import pread()
+    // Import read()
+    // Import type off_t
+    // Import type size_t
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+    // Import type struct io_uring_params
+    // Import type struct io_uring_sqe
+    // Import type struct io_uring_cqe
+#include <sys/mman.h>
+    // Import mmap()
+    // Import munmap()
+#include <sys/syscall.h>
+    // Import constant __NR_io_uring_setup
+    // Import constant __NR_io_uring_enter
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+#include <aread.h>
+#include <cscript.h>
+
+/*
+ * One block-sized read.  Slots are used as a ring, in the order
+ * the reads were issued, which is the order they are handed back.
+ */
+
+struct aread_slot {
+    char    *buf;
+    struct iovec iov;
+    size_t  fnr;
+    off_t   off;        // -1 for "at the file position"
+    size_t  want;
+    ssize_t res;        // Bytes read, or -errno
+    bool    done;
+    bool    last;
+};
+
+typedef struct aread_slot aread_slot_t;
+
+#ifdef HAVE_IO_URING
+
+struct aread_ring {
+    int fd;
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;
+    size_t cq_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned int to_submit;
+};
+
+typedef struct aread_ring aread_ring_t;
+
+#endif
+
+struct aread {
+    size_t filec;
+    char **filev;
+    int *fdv;
+    size_t bsize;
+    unsigned int depth;
+    aread_slot_t *slotv;
+    unsigned int head;      // Next slot to hand back
+    unsigned int nqueued;   // Slots issued, and not yet released
+    bool held;              // The caller holds slot |head|
+
+    // Where the next read will be issued.
+    size_t cur_fnr;
+    off_t cur_off;
+    off_t cur_size;
+    bool cur_open;
+    bool cur_stream;
+    bool stream_busy;       // A read of a stream is in flight
+
+    // A file that ended early, on an error or a short read;
+    // blocks of it that were already issued are dropped.
+    bool dead;
+    size_t dead_fnr;
+
+#ifdef HAVE_IO_URING
+    aread_ring_t *ring;
+#endif
+};
+
+// ################ io_uring, by raw system calls
+
+#ifdef HAVE_IO_URING
+
+static void
+ring_free(aread_ring_t *ring)
+{
+    if (ring == NULL) {
+        return;
+    }
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ptr != NULL && ring->cq_ptr != MAP_FAILED
+        && ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_size);
+    }
+    if (ring->sq_ptr != NULL && ring->sq_ptr != MAP_FAILED) {
+        munmap(ring->sq_ptr, ring->sq_size);
+    }
+    if (ring->fd >= 0) {
+        close(ring->fd);
+    }
+    free(ring);
+}
+
+/*
+ * Set up a ring with room for |entries| reads, or return NULL,
+ * if the kernel does not have io_uring, or will not let us use it.
+ */
+static aread_ring_t *
+ring_new(unsigned int entries)
+{
+    struct io_uring_params p;
+    aread_ring_t *ring;
+    char *sq;
+    char *cq;
+
+    ring = (aread_ring_t *)guard_calloc(1, sizeof (aread_ring_t));
+    memset(&p, 0, sizeof (p));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0) {
+        free(ring);
+        return (NULL);
+    }
+
+    ring->sq_size = p.sq_off.array + p.sq_entries * sizeof (unsigned int);
+    ring->cq_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_size > ring->sq_size) {
+            ring->sq_size = ring->cq_size;
+        }
+        ring->cq_size = ring->sq_size;
+    }
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring_free(ring);
+        return (NULL);
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ptr = ring->sq_ptr;
+    }
+    else {
+        ring->cq_ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED) {
+            ring_free(ring);
+            return (NULL);
+        }
+    }
+    ring->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size,
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring_free(ring);
+        return (NULL);
+    }
+
+    sq = (char *)ring->sq_ptr;
+    cq = (char *)ring->cq_ptr;
+    ring->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+    ring->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned int *)(sq + p.sq_off.array);
+    ring->cq_head = (unsigned int *)(cq + p.cq_off.head);
+    ring->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+    ring->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return (ring);
+}
+
+/*
+ * Queue a read into |slot|.  It is not submitted until ring_enter().
+ * There is never more than |depth| reads queued or in flight, and
+ * the ring has at least that many entries, so there is always room.
+ */
+static void
+ring_queue(aread_ring_t *ring, aread_slot_t *slot, int fd, unsigned int nr)
+{
+    struct io_uring_sqe *sqe;
+    unsigned int tail;
+    unsigned int idx;
+
+    tail = *ring->sq_tail;
+    idx = tail & *ring->sq_mask;
+    sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof (*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)&slot->iov;
+    sqe->len = 1;
+    sqe->off = (slot->off < 0) ? (uint64_t)-1 : (uint64_t)slot->off;
+    sqe->user_data = nr;
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++ring->to_submit;
+}
+
+/*
+ * Submit whatever has been queued, and, if |wait|,
+ * wait for at least one completion.
+ */
+static int
+ring_enter(aread_ring_t *ring, bool wait)
+{
+    unsigned int flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    int rv;
+
+    if (ring->to_submit == 0 && !wait) {
+        return (0);
+    }
+    do {
+        rv = (int)syscall(__NR_io_uring_enter, ring->fd, ring->to_submit,
+            wait ? 1 : 0, flags, NULL, 0);
+    } while (rv < 0 && errno == EINTR);
+    if (rv < 0) {
+        return (errno);
+    }
+    ring->to_submit -= (unsigned int)rv < ring->to_submit
+        ? (unsigned int)rv : ring->to_submit;
+    return (0);
+}
+
+/*
+ * Mark every read that has completed as done.
+ */
+static void
+ring_reap(aread_ring_t *ring, aread_slot_t *slotv)
+{
+    struct io_uring_cqe *cqe;
+    unsigned int head;
+    unsigned int tail;
+
+    head = *ring->cq_head;
+    tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+        cqe = &ring->cqes[head & *ring->cq_mask];
+        slotv[cqe->user_data].res = cqe->res;
+        slotv[cqe->user_data].done = true;
+        ++head;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+#endif /* HAVE_IO_URING */
+
+// ################ Issuing reads, in order
+
+static inline bool
+is_stdin(const char *fname)
+{
+    return (fname[0] == '-' && fname[1] == '\0');
+}
+
+static void
+close_file(aread_t *ar, size_t fnr)
+{
+    if (ar->fdv[fnr] >= 0 && !is_stdin(ar->filev[fnr])) {
+        close(ar->fdv[fnr]);
+    }
+    ar->fdv[fnr] = -1;
+}
+
+static inline aread_slot_t *
+next_free_slot(aread_t *ar, unsigned int *nr_ref)
+{
+    unsigned int nr = (ar->head + ar->nqueued) % ar->depth;
+
+    *nr_ref = nr;
+    ++ar->nqueued;
+    return (&ar->slotv[nr]);
+}
+
+static void
+next_file(aread_t *ar)
+{
+    ++ar->cur_fnr;
+    ar->cur_off = 0;
+    ar->cur_open = false;
+    ar->stream_busy = false;
+}
+
+/*
+ * A block that needs no read: an empty file, or an error from open().
+ */
+static void
+issue_done(aread_t *ar, int err)
+{
+    aread_slot_t *slot;
+    unsigned int nr;
+
+    slot = next_free_slot(ar, &nr);
+    slot->fnr = ar->cur_fnr;
+    slot->off = 0;
+    slot->want = 0;
+    slot->res = -err;
+    slot->done = true;
+    slot->last = true;
+    next_file(ar);
+}
+
+/*
+ * Open the file at the cursor, and find out how to read it.
+ * Return 0, or an errno value.
+ */
+static int
+open_cur(aread_t *ar)
+{
+    const char *fname = ar->filev[ar->cur_fnr];
+    struct stat st;
+    int fd;
+
+    if (is_stdin(fname)) {
+        fd = 0;
+    }
+    else {
+        do {
+            fd = open(fname, O_RDONLY | O_CLOEXEC);
+        } while (fd < 0 && errno == EINTR);
+        if (fd < 0) {
+            return (errno);
+        }
+    }
+    ar->fdv[ar->cur_fnr] = fd;
+    ar->cur_open = true;
+    ar->cur_off = 0;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        ar->cur_stream = false;
+        ar->cur_size = st.st_size;
+        if (fd == 0) {
+            // Standard input may already have been partly read.
+            ar->cur_off = lseek(fd, 0, SEEK_CUR);
+            if (ar->cur_off < 0) {
+                ar->cur_off = 0;
+            }
+        }
+        posix_fadvise(fd, ar->cur_off, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    else {
+        ar->cur_stream = true;
+        ar->cur_size = 0;
+    }
+    return (0);
+}
+
+/*
+ * Issue reads until |depth| are in flight, or there is nothing more
+ * that can be read yet.  A stream gets only one read at a time,
+ * and, until it ends, nothing after it can be read.
+ */
+static void
+fill(aread_t *ar)
+{
+    aread_slot_t *slot;
+    unsigned int nr;
+    size_t want;
+    int fd;
+    int err;
+
+    while (ar->nqueued < ar->depth && ar->cur_fnr < ar->filec
+        && !ar->stream_busy) {
+        if (!ar->cur_open) {
+            err = open_cur(ar);
+            if (err) {
+                issue_done(ar, err);
+                continue;
+            }
+            if (!ar->cur_stream && ar->cur_off >= ar->cur_size) {
+                close_file(ar, ar->cur_fnr);
+                issue_done(ar, 0);
+                continue;
+            }
+        }
+
+        fd = ar->fdv[ar->cur_fnr];
+        slot = next_free_slot(ar, &nr);
+        slot->fnr = ar->cur_fnr;
+        slot->done = false;
+        slot->res = 0;
+        if (ar->cur_stream) {
+            slot->off = -1;
+            slot->want = ar->bsize;
+            slot->last = false;
+            ar->stream_busy = true;
+        }
+        else {
+            want = ar->bsize;
+            if ((off_t)want > ar->cur_size - ar->cur_off) {
+                want = (size_t)(ar->cur_size - ar->cur_off);
+            }
+            slot->off = ar->cur_off;
+            slot->want = want;
+            ar->cur_off += want;
+            slot->last = (ar->cur_off >= ar->cur_size);
+        }
+        slot->iov.iov_base = slot->buf;
+        slot->iov.iov_len = slot->want;
+
+#ifdef HAVE_IO_URING
+        if (ar->ring != NULL) {
+            ring_queue(ar->ring, slot, fd, nr);
+        }
+        else
+#endif
+        if (slot->off >= 0) {
+            posix_fadvise(fd, slot->off, slot->want, POSIX_FADV_WILLNEED);
+        }
+
+        if (slot->last) {
+            next_file(ar);
+        }
+    }
+
+#ifdef HAVE_IO_URING
+    if (ar->ring != NULL) {
+        ring_enter(ar->ring, false);
+    }
+#endif
+}
+
+/*
+ * Do the read for |slot| now, and wait for it.
+ */
+static void
+complete_sync(aread_t *ar, aread_slot_t *slot)
+{
+    int fd = ar->fdv[slot->fnr];
+    ssize_t n;
+
+    do {
+        if (slot->off < 0) {
+            n = read(fd, slot->buf, slot->want);
+        }
+        else {
+            n = pread(fd, slot->buf, slot->want, slot->off);
+        }
+    } while (n < 0 && errno == EINTR);
+    slot->res = (n < 0) ? -errno : n;
+    slot->done = true;
+}
+
+/*
+ * Wait for the read for |slot| to complete, or, without io_uring,
+ * do it now.
+ */
+static void
+slot_wait(aread_t *ar, aread_slot_t *slot)
+{
+#ifdef HAVE_IO_URING
+    if (ar->ring != NULL) {
+        ring_reap(ar->ring, ar->slotv);
+        while (!slot->done) {
+            int err = ring_enter(ar->ring, true);
+
+            ring_reap(ar->ring, ar->slotv);
+            if (err && !slot->done) {
+                slot->res = -err;
+                slot->done = true;
+            }
+        }
+    }
+#endif
+    if (!slot->done) {
+        complete_sync(ar, slot);
+    }
+}
+
+/*
+ * A read at an offset can come back short, for example from a network
+ * file system, or if the file shrank.  Read the rest with pread(2).
+ * If a read fails, the block is an error; if the file ends early,
+ * the block is shorter than asked for.
+ */
+static void
+finish_short(aread_t *ar, aread_slot_t *slot)
+{
+    int fd = ar->fdv[slot->fnr];
+    ssize_t n;
+
+    while (slot->res >= 0 && (size_t)slot->res < slot->want) {
+        n = pread(fd, slot->buf + slot->res, slot->want - slot->res,
+            slot->off + slot->res);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            slot->res = -errno;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        slot->res += n;
+    }
+}
+
+/*
+ * |slot| ends its file early.  Issue nothing more from that file,
+ * and drop any blocks of it that are already queued.
+ */
+static void
+end_file_early(aread_t *ar, aread_slot_t *slot)
+{
+    slot->last = true;
+    ar->dead = true;
+    ar->dead_fnr = slot->fnr;
+    if (ar->cur_fnr == slot->fnr) {
+        next_file(ar);
+    }
+}
+
+/*
+ * Give slot |head| back, for reuse.
+ */
+static void
+release_head(aread_t *ar)
+{
+    aread_slot_t *slot = &ar->slotv[ar->head];
+
+    if (slot->last) {
+        close_file(ar, slot->fnr);
+    }
+    ar->head = (ar->head + 1) % ar->depth;
+    --ar->nqueued;
+}
+
+// ################ Interface
+
+/**
+ * @brief Make a reader for files |filev[0 .. filec-1]|.
+ *
+ * @param depth  in  Most reads in flight; 0 means AREAD_DEPTH_DEFAULT.
+ * @param bsize  in  Block size; 0 means AREAD_BSIZE_DEFAULT.
+ * @param flags  in  AREAD_* flags
+ *
+ * Nothing is opened or read until the first aread_next().
+ */
+aread_t *
+aread_new(size_t filec, char **filev, unsigned int depth, size_t bsize,
+    unsigned int flags)
+{
+    aread_t *ar;
+    unsigned int i;
+    size_t f;
+
+    if (depth == 0) {
+        depth = AREAD_DEPTH_DEFAULT;
+    }
+    if (bsize == 0) {
+        bsize = AREAD_BSIZE_DEFAULT;
+    }
+    ar = (aread_t *)guard_calloc(1, sizeof (aread_t));
+    ar->filec = filec;
+    ar->filev = filev;
+    ar->depth = depth;
+    ar->bsize = bsize;
+    ar->fdv = (int *)guard_calloc(filec + 1, sizeof (int));
+    for (f = 0; f < filec; ++f) {
+        ar->fdv[f] = -1;
+    }
+    ar->slotv = (aread_slot_t *)guard_calloc(depth, sizeof (aread_slot_t));
+    for (i = 0; i < depth; ++i) {
+        ar->slotv[i].buf = (char *)guard_malloc(bsize);
+    }
+
+#ifdef HAVE_IO_URING
+    if (!(flags & AREAD_SYNC)) {
+        ar->ring = ring_new(depth);
+    }
+#else
+    (void)flags;
+#endif
+    return (ar);
+}
+
+/**
+ * @brief Is the reader using io_uring, as opposed to pread(2)?
+ */
+bool
+aread_async(const aread_t *ar)
+{
+#ifdef HAVE_IO_URING
+    return (ar->ring != NULL);
+#else
+    (void)ar;
+    return (false);
+#endif
+}
+
+/**
+ * @brief Wait for the next block, in order, and hand it back in |blk|.
+ *
+ * The block's buffer stays valid until the next call.
+ * Every file gives at least one block; the last one from each
+ * file has |last| set, and may be empty.
+ *
+ * @return 0, or ENODATA when there are no more files.
+ */
+int
+aread_next(aread_t *ar, aread_block_t *blk)
+{
+    aread_slot_t *slot;
+
+    if (ar->held) {
+        // Release the block the caller had, and reuse its slot.
+        release_head(ar);
+        ar->held = false;
+    }
+
+    while (true) {
+        fill(ar);
+        if (ar->nqueued == 0) {
+            return (ENODATA);
+        }
+        slot = &ar->slotv[ar->head];
+        if (!(ar->dead && slot->fnr == ar->dead_fnr)) {
+            break;
+        }
+        // Past the end of a file that ended early.
+#ifdef HAVE_IO_URING
+        if (ar->ring != NULL) {
+            // The kernel may still write into the buffer.
+            slot_wait(ar, slot);
+        }
+#endif
+        slot->last = false;
+        release_head(ar);
+    }
+    slot_wait(ar, slot);
+
+    if (slot->off < 0) {
+        // A stream ends only when a read comes back empty.
+        ar->stream_busy = false;
+        if (slot->res <= 0) {
+            slot->last = true;
+            next_file(ar);
+        }
+    }
+    else {
+        if (slot->res >= 0 && (size_t)slot->res < slot->want) {
+            finish_short(ar, slot);
+        }
+        if (slot->res < 0 || (size_t)slot->res < slot->want) {
+            end_file_early(ar, slot);
+        }
+    }
+
+    blk->buf = slot->buf;
+    blk->len = (slot->res > 0) ? (size_t)slot->res : 0;
+    blk->fnr = slot->fnr;
+    blk->err = (slot->res < 0) ? (int)-slot->res : 0;
+    blk->last = slot->last;
+    ar->held = true;
+    return (0);
+}
+
+/**
+ * @brief Free the reader.  Any reads still in flight are waited for.
+ */
+void
+aread_free(aread_t *ar)
+{
+    unsigned int i;
+    size_t f;
+
+    if (ar == NULL) {
+        return;
+    }
+#ifdef HAVE_IO_URING
+    if (ar->ring != NULL) {
+        // The kernel may still write into the buffers.
+        for (i = 0; i < ar->depth; ++i) {
+            unsigned int nr = (ar->head + i) % ar->depth;
+
+            if (i >= ar->nqueued) {
+                break;
+            }
+            while (!ar->slotv[nr].done) {
+                if (ring_enter(ar->ring, true) != 0) {
+                    break;
+                }
+                ring_reap(ar->ring, ar->slotv);
+            }
+        }
+        ring_free(ar->ring);
+    }
+#endif
+    for (f = 0; f < ar->filec; ++f) {
+        close_file(ar, f);
+    }
+    for (i = 0; i < ar->depth; ++i) {
+        free(ar->slotv[i].buf);
+    }
+    free(ar->slotv);
+    free(ar->fdv);
+    free(ar);
+}
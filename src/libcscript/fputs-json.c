@@ -0,0 +1,64 @@
+/*
+ * Filename: fputs-json.c
+ * Library: libcscript
+ * Brief: Write a string to an stdio stream as a JSON string literal
+ *
+ * Copyright (C) 2015-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+    // Import type size_t
+#include <stdio.h>
+    // Import type FILE
+    // Import fprintf()
+    // Import fputc()
+
+/**
+ * @brief Write |s|, quoted and escaped, as a JSON string.
+ *
+ * Quote and backslash are escaped; other control characters
+ * are written as \uXXXX.  Bytes >= 0x80 are passed through,
+ * on the assumption that |s| is UTF-8.
+ *
+ * @return the number of bytes written.
+ */
+size_t
+fputs_json(FILE *f, const char *s)
+{
+    size_t n;
+
+    fputc('"', f);
+    n = 2;
+    for (; *s != '\0'; ++s) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fputc('\\', f);
+            fputc(c, f);
+            n += 2;
+        }
+        else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+            n += 6;
+        }
+        else {
+            fputc(c, f);
+            ++n;
+        }
+    }
+    fputc('"', f);
+    return (n);
+}
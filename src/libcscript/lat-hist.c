@@ -0,0 +1,152 @@
+/*
+ * Filename: lat-hist.c
+ * Library: libcscript
+ * Brief: Log-linear latency histograms, cheap to record, easy to merge
+ *
+ * Copyright (C) 2015-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+    // Import type uint64_t
+    // Import constant UINT64_MAX
+#include <stdio.h>
+    // Import type FILE
+    // Import fprintf()
+#include <string.h>
+    // Import memset()
+
+#include <lat-hist.h>
+
+void
+lat_hist_init(lat_hist_t *h, const char *name)
+{
+    memset(h, 0, sizeof (lat_hist_t));
+    h->name = name;
+    h->min = UINT64_MAX;
+}
+
+/**
+ * @brief The smallest value that is recorded in bucket |idx|.
+ */
+uint64_t
+lat_hist_bucket_lbound(unsigned int idx)
+{
+    unsigned int g;
+    uint64_t m;
+
+    if (idx < LAT_HIST_SUB) {
+        return (idx);
+    }
+    g = idx / LAT_HIST_SUB;
+    m = LAT_HIST_SUB + idx % LAT_HIST_SUB;
+    return (m << (g - 1));
+}
+
+void
+lat_hist_merge(lat_hist_t *dst, const lat_hist_t *src)
+{
+    unsigned int i;
+
+    for (i = 0; i < LAT_HIST_NBUCKETS; ++i) {
+        dst->bucketv[i] += src->bucketv[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+/**
+ * @brief Value at quantile |q| (0.0 to 1.0).
+ *
+ * Returns the upper end of the bucket that holds the quantile,
+ * so the answer errs on the high side, by at most one bucket width.
+ * Returns 0 for an empty histogram.
+ */
+uint64_t
+lat_hist_quantile(const lat_hist_t *h, double q)
+{
+    uint64_t rank;
+    uint64_t seen;
+    uint64_t hi;
+    unsigned int i;
+
+    if (h->count == 0) {
+        return (0);
+    }
+    rank = (uint64_t)(q * (double)(h->count - 1)) + 1;
+    seen = 0;
+    for (i = 0; i < LAT_HIST_NBUCKETS; ++i) {
+        seen += h->bucketv[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    if (i + 1 >= LAT_HIST_NBUCKETS) {
+        return (h->max);
+    }
+    hi = lat_hist_bucket_lbound(i + 1) - 1;
+    return (hi < h->max ? hi : h->max);
+}
+
+/**
+ * @brief Write a histogram in a form that can be read by people,
+ * and merged by machines.
+ *
+ * The format is line-oriented and tab-separated:
+ *
+ *     # <name> n=<count> p50=... p90=... p99=... p999=... max=...
+ *     H <name> <count> <sum> <min> <max>
+ *     B <name> <bucket-lower-bound> <count>     (non-empty buckets only)
+ *
+ * All values are in whatever unit was recorded (nanoseconds, here).
+ * Dumps from many processes merge by summing H counts and sums,
+ * taking the min of mins and the max of maxes, and summing
+ * the B counts for each { name, bound }.
+ */
+void
+fdump_lat_hist(FILE *f, const lat_hist_t *h)
+{
+    unsigned int i;
+
+    fprintf(f, "# %s n=%llu p50=%llu p90=%llu p99=%llu p999=%llu max=%llu\n",
+        h->name,
+        (unsigned long long)h->count,
+        (unsigned long long)lat_hist_quantile(h, 0.50),
+        (unsigned long long)lat_hist_quantile(h, 0.90),
+        (unsigned long long)lat_hist_quantile(h, 0.99),
+        (unsigned long long)lat_hist_quantile(h, 0.999),
+        (unsigned long long)(h->count ? h->max : 0));
+    fprintf(f, "H\t%s\t%llu\t%llu\t%llu\t%llu\n",
+        h->name,
+        (unsigned long long)h->count,
+        (unsigned long long)h->sum,
+        (unsigned long long)(h->count ? h->min : 0),
+        (unsigned long long)(h->count ? h->max : 0));
+    for (i = 0; i < LAT_HIST_NBUCKETS; ++i) {
+        if (h->bucketv[i] != 0) {
+            fprintf(f, "B\t%s\t%llu\t%llu\n",
+                h->name,
+                (unsigned long long)lat_hist_bucket_lbound(i),
+                (unsigned long long)h->bucketv[i]);
+        }
+    }
+}
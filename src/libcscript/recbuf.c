@@ -0,0 +1,171 @@
+/*
+ * Filename: recbuf.c
+ * Library: libcscript
+ * Brief: Read delimited records from a file descriptor, a block at a time
+ *
+ * Copyright (C) 2015-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+    // Import var errno
+    // Import constant EINTR
+#include <stdbool.h>
+    // Import type bool
+#include <stddef.h>
+    // Import constant NULL
+#include <stdlib.h>
+    // Import free()
+#include <string.h>
+    // Import memchr()
+    // Import memmove()
+#include <unistd.h>
+    // Import read()
+    // Import type size_t
+    // Import type ssize_t
+
+#include <cscript.h>
+#include <recbuf.h>
+
+/**
+ * @brief Make a record reader for file descriptor |fd|.
+ *
+ * @param size  in  Initial buffer size; 0 means RECBUF_SIZE_DEFAULT.
+ */
+recbuf_t *
+recbuf_new(int fd, size_t size)
+{
+    recbuf_t *rb;
+
+    if (size < 2) {
+        size = RECBUF_SIZE_DEFAULT;
+    }
+    rb = (recbuf_t *)guard_calloc(1, sizeof (recbuf_t));
+    rb->fd = fd;
+    rb->size = size;
+    rb->buf = (char *)guard_malloc(size);
+    return (rb);
+}
+
+/**
+ * @brief Read with |fn|(|arg|, buf, n), instead of read(|fd|, buf, n).
+ */
+void
+recbuf_set_reader(recbuf_t *rb, recbuf_read_fn_t *fn, void *arg)
+{
+    rb->read_fn = fn;
+    rb->read_arg = arg;
+}
+
+void
+recbuf_free(recbuf_t *rb)
+{
+    if (rb == NULL) {
+        return;
+    }
+    free(rb->buf);
+    free(rb);
+}
+
+/*
+ * Make room for more input, after the unread data,
+ * then read as much as will fit.
+ * One byte is always kept spare, so that a last record
+ * with no delimiter can still be terminated in place.
+ */
+static void
+recbuf_fill(recbuf_t *rb)
+{
+    ssize_t n;
+
+    if (rb->head != 0) {
+        memmove(rb->buf, rb->buf + rb->head, rb->tail - rb->head);
+        rb->tail -= rb->head;
+        rb->scan -= rb->head;
+        rb->head = 0;
+    }
+    if (rb->tail + 1 >= rb->size) {
+        rb->size *= 2;
+        rb->buf = (char *)guard_realloc(rb->buf, rb->size);
+    }
+
+    do {
+        if (rb->read_fn != NULL) {
+            n = rb->read_fn(rb->read_arg, rb->buf + rb->tail,
+                rb->size - 1 - rb->tail);
+        }
+        else {
+            n = read(rb->fd, rb->buf + rb->tail, rb->size - 1 - rb->tail);
+        }
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        rb->err = errno;
+        rb->eof = true;
+    }
+    else if (n == 0) {
+        rb->eof = true;
+    }
+    else {
+        rb->tail += n;
+    }
+}
+
+/**
+ * @brief Return the next record, up to but not including |delim|.
+ *
+ * The record is NUL-terminated, and stays valid until the next call.
+ * A last record that has no delimiter is returned as it is.
+ *
+ * @param rb       in   Reader
+ * @param delim    in   Record delimiter; any byte, including '\0'
+ * @param len_ref  out  Length of the record
+ * @return the record, or NULL at end of input, or on error (see |err|).
+ */
+char *
+recbuf_getrec(recbuf_t *rb, int delim, size_t *len_ref)
+{
+    char *rec;
+    char *end;
+
+    while (true) {
+        end = (char *)memchr(rb->buf + rb->scan, delim, rb->tail - rb->scan);
+        if (end != NULL) {
+            break;
+        }
+        rb->scan = rb->tail;
+        if (rb->eof) {
+            if (rb->head == rb->tail) {
+                return (NULL);
+            }
+            end = rb->buf + rb->tail;
+            break;
+        }
+        recbuf_fill(rb);
+    }
+
+    rec = rb->buf + rb->head;
+    *end = '\0';
+    *len_ref = (size_t)(end - rec);
+    rb->head = (size_t)(end - rb->buf);
+    if (rb->head < rb->tail) {
+        ++rb->head;
+    }
+    rb->scan = rb->head;
+    return (rec);
+}
@@ -50,10 +50,18 @@ struct sgl {
 
 typedef struct sgl sgl_t;
 
+// The pages of a scatter/gather list are kept from one line
+// to the next, and reused.  |sgl_cur| and |sgl_idx| tell where
+// the next page to be filled is; every page before it holds
+// part of the current line, and every page after it is spare,
+// with |slen| == 0.
+//
 struct linebuf {
     FILE   *f;
     char   *buf;
     sgl_t  *sgl;
+    sgl_t  *sgl_cur;
+    size_t sgl_idx;
     size_t siz;
     size_t len;
     int    err;
@@ -67,6 +75,9 @@ linebuf_init(linebuf_t *lbuf, FILE *f)
 {
     lbuf->f = f;
     lbuf->buf = NULL;
+    lbuf->sgl = NULL;
+    lbuf->sgl_cur = NULL;
+    lbuf->sgl_idx = 0;
     lbuf->siz = 0;
     lbuf->len = 0;
     lbuf->err = 0;
@@ -103,81 +114,80 @@ linebuf_sgl_new(linebuf_t *lbuf)
 
     sglp = sgl_new();
     lbuf->sgl = sglp;
+    lbuf->sgl_cur = sglp;
+    lbuf->sgl_idx = 0;
 }
 
 // Prepare to append data to a scatter/gather list.
-// Allocate a new page.
-// Append a page to a scatter/gather list.
-// If all segments in the linked list of segments are occupied,
-// then allocate a new whole segment and append that to the linked
-// list of segments.
+// Take the next page, at the cursor; allocate it only if it
+// has never been used before.  If all pages in the current
+// sgl-segment are taken, move on to the next sgl-segment,
+// appending a new one to the linked list if there is none.
 //
-// Append a new page to the last segment of the scatter/gather list.
+// The cursor is kept in the linebuf_t, so there is no need
+// to scan the linked list of segments from its head.
 //
 static sglsegment_t *
-sgl_append(sgl_t *sglp)
+sgl_append(linebuf_t *lbuf)
 {
-    sgl_t * new_sglp;
-    sglsegment_t *sglv;
-    unsigned int i;
-    char *rbuf;
+    sgl_t *sglp;
+    sglsegment_t *seg;
 
+    sglp = lbuf->sgl_cur;
     if (sglp == NULL) {
         abort();
     }
 
-    // Scan to the end of the linked list of sgl-segments.
-    // If there are any available slots, they will be in the last segment.
-    // If there are no vacancies, then a new sgl-segment will be appended
-    // to the linked list of segments.
-    while (sglp->sgl_next != NULL) {
+    if (lbuf->sgl_idx == SGL_SEGSIZE) {
+        if (sglp->sgl_next == NULL) {
+            sglp->sgl_next = sgl_new();
+        }
         sglp = sglp->sgl_next;
+        lbuf->sgl_cur = sglp;
+        lbuf->sgl_idx = 0;
     }
 
-    // See if there is an empty slot in the last sgl segment
-    // in the linked list of segments.
-    sglv = &sglp->sgl_segv[0];
-    for (i = 0; i < SGL_SEGSIZE; ++i) {
-        if (sglv[i].sbuf == NULL) {
-            rbuf = (char *)guard_malloc(SGL_PAGESIZE);
-            sglv[i].sbuf = rbuf;
-            return (&sglv[i]);
-        }
+    seg = &sglp->sgl_segv[lbuf->sgl_idx++];
+    if (seg->sbuf == NULL) {
+        seg->sbuf = (char *)guard_malloc(SGL_PAGESIZE);
     }
-
-    new_sglp = (sgl_t *)guard_calloc(1, sizeof (sgl_t));
-    sglp->sgl_next = new_sglp;
-    rbuf = (char *)guard_malloc(SGL_PAGESIZE);
-    sglv[0].sbuf = rbuf;
-    return (&sglv[0]);
+    seg->slen = 0;
+    return (seg);
 }
 
-
+// Copy the pages of the current line, up to the cursor, into |rbuf|,
+// and rewind the cursor, so that the pages can be used again.
+//
 static void
-sgl_str_build(char *rbuf, size_t sz, sgl_t *sglp)
+sgl_str_build(char *rbuf, size_t sz, linebuf_t *lbuf)
 {
+    sgl_t *sglp;
     size_t rlen;
 
     rlen = 0;
-    while (sglp != NULL) {
+    for (sglp = lbuf->sgl; sglp != NULL; sglp = sglp->sgl_next) {
         sglsegment_t *sglv;
-        unsigned int i;
+        size_t n;
+        size_t i;
 
         sglv = &sglp->sgl_segv[0];
-        for (i = 0; i < SGL_SEGSIZE; ++i) {
-            if (sglv[i].sbuf == NULL) {
-                break;
-            }
+        n = (sglp == lbuf->sgl_cur) ? lbuf->sgl_idx : SGL_SEGSIZE;
+        for (i = 0; i < n; ++i) {
             if (rlen + sglv[i].slen > sz) {
                 abort();
             }
             memcpy(rbuf + rlen, sglv[i].sbuf, sglv[i].slen);
             rlen += sglv[i].slen;
+            sglv[i].slen = 0;
+        }
+        if (sglp == lbuf->sgl_cur) {
+            break;
         }
-        sglp = sglp->sgl_next;
     }
 
     rbuf[rlen] = '\0';
+    lbuf->sgl_cur = lbuf->sgl;
+    lbuf->sgl_idx = 0;
 }
 
 // XXX sgl_strlen() Is currently not used.
@@ -254,6 +264,8 @@ linebuf_free(linebuf_t *lbuf)
     if (lbuf->sgl != NULL) {
         free_sgl(lbuf->sgl);
         lbuf->sgl = NULL;
+        lbuf->sgl_cur = NULL;
+        lbuf->sgl_idx = 0;
     }
 }
 
@@ -318,20 +330,18 @@ sgl_fgetline(linebuf_t *lbuf, int endl)
 
     dbg_printf("> %s\n", __FUNCTION__);
 
-    // Free up any resources leftover from the last time
-    // this line buffer was used.
+    // The scatter/gather list and the line buffer are kept
+    // from the last time this line buffer was used.
     //
-    // In particlur, free up any segments of a scatter/gather list
-    // and the line buffer.
-    //
-    linebuf_free(lbuf);
-    linebuf_sgl_new(lbuf);
+    if (lbuf->sgl == NULL) {
+        linebuf_sgl_new(lbuf);
+    }
     llen = 0;
 
     // Read one sgl-segment at a time.
     //
     while (true) {
-        sglv = sgl_append(lbuf->sgl);
+        sglv = sgl_append(lbuf);
         if (endl == '\n') {
             rbuf = fgets(sglv->sbuf, SGL_PAGESIZE, lbuf->f);
         }
@@ -358,8 +368,11 @@ sgl_fgetline(linebuf_t *lbuf, int endl)
         llen += slen;
     }
 
-    lbuf->buf = (char *)guard_malloc(llen + 1);
-    sgl_str_build(lbuf->buf, llen + 1, lbuf->sgl);
+    if (lbuf->siz < llen + 1) {
+        lbuf->siz = llen + 1;
+        lbuf->buf = (char *)guard_realloc(lbuf->buf, lbuf->siz);
+    }
+    sgl_str_build(lbuf->buf, lbuf->siz, lbuf);
     lbuf->len = llen;
     dbg_printf("< %s\n", __FUNCTION__);
     dbg_printf("    line: [%s]\n", lbuf->buf);
@@ -0,0 +1,1039 @@
+/*
+ * Filename: src/libcscript/zstream.c
+ * Project: libcscript
+ * Brief: Compressed input and output streams, with the codec on threads
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <errno.h>
+    // Import var errno
+    // Import constant EBADMSG
+    // Import constant EINTR
+    // Import constant EINVAL
+    // Import constant EIO
+    // Import constant ENOMEM
+    // Import constant ENOTSUP
+#include <pthread.h>
+    // Import pthread_cancel()
+    // Import pthread_cond_broadcast()
+    // Import pthread_cond_wait()
+    // Import pthread_create()
+    // Import pthread_join()
+    // Import pthread_mutex_lock()
+    // Import pthread_mutex_unlock()
+    // Import pthread_setcancelstate()
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stddef.h>
+    // Import constant NULL
+#include <stdio.h>
+    // Import type FILE
+    // Import fopencookie()
+#include <stdlib.h>
+    // Import free()
+#include <string.h>
+    // Import memcmp()
+    // Import memcpy()
+    // Import memset()
+#include <unistd.h>
+    // Import read()
+    // Import sysconf()
+    // Import write()
+    // Import type size_t
+    // Import type ssize_t
+
+#include <zlib.h>
+    // Import deflate()
+    // Import inflate()
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+    // Import ZSTD_compressCCtx()
+    // Import ZSTD_decompressStream()
+#endif
+
+#include <cscript.h>
+#include <zstream.h>
+
+#define SNIFF_LEN   4
+#define ZOUT_THREADS_MAX 8
+
+/*
+ * A block of plain data; for output, also its compressed form.
+ */
+struct zblock {
+    char   *buf;
+    size_t len;
+    char   *obuf;
+    size_t olen;
+    int    state;
+};
+
+// States of an output block
+enum { ZB_FREE, ZB_FILLED, ZB_BUSY, ZB_DONE };
+
+static inline size_t
+min_size(size_t a, size_t b)
+{
+    return (a < b ? a : b);
+}
+
+static struct zblock *
+zblock_ring_new(size_t depth, size_t bsize, size_t osize)
+{
+    struct zblock *ringv;
+    size_t i;
+
+    ringv = (struct zblock *)guard_calloc(depth, sizeof (struct zblock));
+    for (i = 0; i < depth; ++i) {
+        ringv[i].buf = (char *)guard_malloc(bsize);
+        if (osize != 0) {
+            ringv[i].obuf = (char *)guard_malloc(osize);
+        }
+    }
+    return (ringv);
+}
+
+static void
+zblock_ring_free(struct zblock *ringv, size_t depth)
+{
+    size_t i;
+
+    if (ringv == NULL) {
+        return;
+    }
+    for (i = 0; i < depth; ++i) {
+        free(ringv[i].buf);
+        free(ringv[i].obuf);
+    }
+    free(ringv);
+}
+
+// ################ codecs
+
+/*
+ * gzip is 1f 8b, then 08 for deflate; zstd frames start
+ * with 28 b5 2f fd.
+ */
+static const struct {
+    zs_codec_t codec;
+    size_t     len;
+    unsigned char magic[SNIFF_LEN];
+} magicv[] = {
+    { ZS_GZIP, 3, { 0x1f, 0x8b, 0x08 } },
+    { ZS_ZSTD, 4, { 0x28, 0xb5, 0x2f, 0xfd } },
+};
+
+#define NMAGIC (sizeof (magicv) / sizeof (magicv[0]))
+
+/**
+ * @brief Tell the codec of a stream from its first few bytes.
+ *
+ * Anything that does not start with a known magic number is ZS_NONE.
+ */
+zs_codec_t
+zs_sniff(const void *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < NMAGIC; ++i) {
+        if (len >= magicv[i].len
+            && memcmp(buf, magicv[i].magic, magicv[i].len) == 0) {
+            return (magicv[i].codec);
+        }
+    }
+    return (ZS_NONE);
+}
+
+/*
+ * Could more bytes still make |buf| a magic number?
+ * If not, there is no point in waiting for them; on a pipe,
+ * or a terminal, they might not come until much later.
+ */
+static bool
+sniff_more(const void *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < NMAGIC; ++i) {
+        if (len < magicv[i].len
+            && memcmp(buf, magicv[i].magic, len) == 0) {
+            return (true);
+        }
+    }
+    return (false);
+}
+
+const char *
+zs_codec_name(zs_codec_t codec)
+{
+    switch (codec) {
+    case ZS_NONE:
+        return ("none");
+    case ZS_AUTO:
+        return ("auto");
+    case ZS_GZIP:
+        return ("gzip");
+    case ZS_ZSTD:
+        return ("zstd");
+    }
+    return ("?");
+}
+
+bool
+zs_codec_available(zs_codec_t codec)
+{
+#ifndef HAVE_ZSTD
+    if (codec == ZS_ZSTD) {
+        return (false);
+    }
+#endif
+    return (codec >= ZS_NONE && codec <= ZS_ZSTD);
+}
+
+// ################ input
+
+struct zin {
+    int        fd;
+    zs_codec_t codec;
+    char       sniff[SNIFF_LEN];
+    size_t     sniff_len;
+    size_t     sniff_off;
+
+    // Shared between the reader and the decoder, under |mutex|
+    pthread_t  thread;
+    bool       threaded;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    struct zblock *ringv;
+    size_t     depth;
+    size_t     bsize;
+    size_t     rd;          // Next block for the reader, ringv[rd % depth]
+    size_t     nfull;       // Blocks decoded, and not yet used up
+    size_t     off;         // Offset into the reader's current block
+    bool       done;        // The decoder has sent its last block
+    bool       stop;        // The reader is gone; the decoder should quit
+    int        err;         // Decoder error, after the last block
+
+    // Used only by the decoder
+    char       *ibuf;
+    size_t     in_off;
+    size_t     in_len;
+    bool       in_member;   // Inside a gzip member or zstd frame
+    z_stream   z;
+#ifdef HAVE_ZSTD
+    ZSTD_DStream *zds;
+#endif
+};
+
+/*
+ * Read compressed bytes: first whatever was read to sniff the codec,
+ * then straight from the file descriptor.
+ *
+ * The decoder thread can be cancelled only while it waits in read(),
+ * where it holds no lock, and nothing is half done.
+ */
+static ssize_t
+zin_raw_read(zin_t *zin, char *buf, size_t n)
+{
+    ssize_t rv;
+    int state;
+
+    if (zin->sniff_off < zin->sniff_len) {
+        rv = min_size(n, zin->sniff_len - zin->sniff_off);
+        memcpy(buf, zin->sniff + zin->sniff_off, rv);
+        zin->sniff_off += rv;
+        return (rv);
+    }
+    do {
+        if (zin->threaded) {
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &state);
+        }
+        rv = read(zin->fd, buf, n);
+        if (zin->threaded) {
+            pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+        }
+    } while (rv < 0 && errno == EINTR);
+    return (rv);
+}
+
+static int
+gzip_step(zin_t *zin, struct zblock *blk)
+{
+    z_stream *z = &zin->z;
+    int ret;
+
+    z->next_in = (unsigned char *)zin->ibuf + zin->in_off;
+    z->avail_in = zin->in_len - zin->in_off;
+    z->next_out = (unsigned char *)blk->buf + blk->len;
+    z->avail_out = zin->bsize - blk->len;
+    zin->in_member = true;
+    ret = inflate(z, Z_NO_FLUSH);
+    zin->in_off = zin->in_len - z->avail_in;
+    blk->len = zin->bsize - z->avail_out;
+    if (ret == Z_STREAM_END) {
+        // There may be another member after this one.
+        zin->in_member = false;
+        inflateReset(z);
+        return (0);
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        return (EBADMSG);
+    }
+    return (0);
+}
+
+#ifdef HAVE_ZSTD
+
+static int
+zstd_step(zin_t *zin, struct zblock *blk)
+{
+    ZSTD_inBuffer in;
+    ZSTD_outBuffer out;
+    size_t ret;
+
+    in.src = zin->ibuf;
+    in.size = zin->in_len;
+    in.pos = zin->in_off;
+    out.dst = blk->buf;
+    out.size = zin->bsize;
+    out.pos = blk->len;
+    ret = ZSTD_decompressStream(zin->zds, &out, &in);
+    if (ZSTD_isError(ret)) {
+        return (EBADMSG);
+    }
+    zin->in_off = in.pos;
+    blk->len = out.pos;
+    // 0 means the end of a frame
+    zin->in_member = ret != 0;
+    return (0);
+}
+
+#endif
+
+/*
+ * Decode into |blk| until it is full, or the input ends.
+ * Input that ends inside a member or frame is an error.
+ */
+static int
+zin_decode(zin_t *zin, struct zblock *blk, bool *eof_ref)
+{
+    ssize_t n;
+    int err;
+
+    blk->len = 0;
+    while (blk->len < zin->bsize) {
+        if (zin->in_off == zin->in_len) {
+            n = zin_raw_read(zin, zin->ibuf, zin->bsize);
+            if (n < 0) {
+                return (errno);
+            }
+            if (n == 0) {
+                *eof_ref = true;
+                return (zin->in_member ? EBADMSG : 0);
+            }
+            zin->in_off = 0;
+            zin->in_len = n;
+        }
+#ifdef HAVE_ZSTD
+        if (zin->codec == ZS_ZSTD) {
+            err = zstd_step(zin, blk);
+        }
+        else
+#endif
+        err = gzip_step(zin, blk);
+        if (err) {
+            return (err);
+        }
+    }
+    return (0);
+}
+
+static void *
+zin_thread(void *arg)
+{
+    zin_t *zin = (zin_t *)arg;
+    struct zblock *blk;
+    size_t wr;
+    bool eof;
+    bool stop;
+    int state;
+    int err;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+    wr = 0;
+    eof = false;
+    err = 0;
+    while (!eof && err == 0) {
+        pthread_mutex_lock(&zin->mutex);
+        while (zin->nfull == zin->depth && !zin->stop) {
+            pthread_cond_wait(&zin->cond, &zin->mutex);
+        }
+        stop = zin->stop;
+        pthread_mutex_unlock(&zin->mutex);
+        if (stop) {
+            break;
+        }
+
+        blk = &zin->ringv[wr % zin->depth];
+        err = zin_decode(zin, blk, &eof);
+        if (blk->len != 0) {
+            pthread_mutex_lock(&zin->mutex);
+            ++zin->nfull;
+            pthread_cond_broadcast(&zin->cond);
+            pthread_mutex_unlock(&zin->mutex);
+            ++wr;
+        }
+    }
+
+    pthread_mutex_lock(&zin->mutex);
+    zin->err = err;
+    zin->done = true;
+    pthread_cond_broadcast(&zin->cond);
+    pthread_mutex_unlock(&zin->mutex);
+    return (NULL);
+}
+
+static int
+zin_codec_init(zin_t *zin)
+{
+    if (zin->codec == ZS_GZIP) {
+        // 15 + 32: the largest window, and a gzip or zlib header
+        if (inflateInit2(&zin->z, 15 + 32) != Z_OK) {
+            return (ENOMEM);
+        }
+        return (0);
+    }
+#ifdef HAVE_ZSTD
+    zin->zds = ZSTD_createDStream();
+    if (zin->zds == NULL) {
+        return (ENOMEM);
+    }
+    ZSTD_initDStream(zin->zds);
+#endif
+    return (0);
+}
+
+static void
+zin_codec_fini(zin_t *zin)
+{
+    if (zin->codec == ZS_GZIP) {
+        inflateEnd(&zin->z);
+    }
+#ifdef HAVE_ZSTD
+    if (zin->zds != NULL) {
+        ZSTD_freeDStream(zin->zds);
+    }
+#endif
+}
+
+/**
+ * @brief Start reading a possibly compressed stream from |fd|.
+ *
+ * @param zin_ref  out  Reader; NULL on error.
+ * @param fd       in   File descriptor; it is not closed by zin_close().
+ * @param codec    in   ZS_AUTO, to go by the first bytes, or
+ *                      the codec to insist on; ZS_NONE is a no-op.
+ * @return 0, or an errno.  ENOTSUP means the input is zstd,
+ *         but zstd support was not built in.
+ */
+int
+zin_open(zin_t **zin_ref, int fd, zs_codec_t codec)
+{
+    zin_t *zin;
+    ssize_t n;
+    int err;
+
+    *zin_ref = NULL;
+    zin = (zin_t *)guard_calloc(1, sizeof (zin_t));
+    zin->fd = fd;
+    if (codec == ZS_AUTO) {
+        while (sniff_more(zin->sniff, zin->sniff_len)) {
+            n = read(fd, zin->sniff + zin->sniff_len,
+                SNIFF_LEN - zin->sniff_len);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                err = errno;
+                free(zin);
+                return (err);
+            }
+            if (n == 0) {
+                break;
+            }
+            zin->sniff_len += n;
+        }
+        codec = zs_sniff(zin->sniff, zin->sniff_len);
+    }
+    if (!zs_codec_available(codec)) {
+        free(zin);
+        return (ENOTSUP);
+    }
+    zin->codec = codec;
+    if (codec == ZS_NONE) {
+        *zin_ref = zin;
+        return (0);
+    }
+
+    err = zin_codec_init(zin);
+    if (err) {
+        free(zin);
+        return (err);
+    }
+    zin->depth = ZS_DEPTH_DEFAULT;
+    zin->bsize = ZS_BSIZE_DEFAULT;
+    zin->ringv = zblock_ring_new(zin->depth, zin->bsize, 0);
+    zin->ibuf = (char *)guard_malloc(zin->bsize);
+    pthread_mutex_init(&zin->mutex, NULL);
+    pthread_cond_init(&zin->cond, NULL);
+    zin->threaded = true;
+    err = pthread_create(&zin->thread, NULL, zin_thread, zin);
+    if (err) {
+        zin->threaded = false;
+        zin_close(zin);
+        return (err);
+    }
+    *zin_ref = zin;
+    return (0);
+}
+
+/**
+ * @brief Read up to |n| plain bytes; the same contract as read(2).
+ *
+ * |zin| is a zin_t; it is passed as void *, so that this can be
+ * given to recbuf_set_reader() as it is.
+ * A corrupt or truncated stream fails with errno EBADMSG,
+ * after all the data before the damage has been returned.
+ */
+ssize_t
+zin_read(void *arg, void *buf, size_t n)
+{
+    zin_t *zin = (zin_t *)arg;
+    struct zblock *blk;
+    size_t len;
+    int err;
+
+    if (zin->codec == ZS_NONE) {
+        if (zin->sniff_off < zin->sniff_len) {
+            return (zin_raw_read(zin, (char *)buf, n));
+        }
+        return (read(zin->fd, buf, n));
+    }
+
+    pthread_mutex_lock(&zin->mutex);
+    while (true) {
+        if (zin->nfull != 0) {
+            blk = &zin->ringv[zin->rd % zin->depth];
+            if (zin->off < blk->len) {
+                break;
+            }
+            // Hand the used-up block back to the decoder.
+            ++zin->rd;
+            --zin->nfull;
+            zin->off = 0;
+            pthread_cond_broadcast(&zin->cond);
+            continue;
+        }
+        if (zin->done) {
+            err = zin->err;
+            pthread_mutex_unlock(&zin->mutex);
+            if (err) {
+                errno = err;
+                return (-1);
+            }
+            return (0);
+        }
+        pthread_cond_wait(&zin->cond, &zin->mutex);
+    }
+    pthread_mutex_unlock(&zin->mutex);
+
+    // The decoder does not touch a block until it is handed back.
+    len = min_size(n, blk->len - zin->off);
+    memcpy(buf, blk->buf + zin->off, len);
+    zin->off += len;
+    return (len);
+}
+
+zs_codec_t
+zin_codec(const zin_t *zin)
+{
+    return (zin->codec);
+}
+
+/**
+ * @brief Stop the decoder, if it is still going, and free |zin|.
+ *
+ * @return the decoder's error, if any.
+ */
+int
+zin_close(zin_t *zin)
+{
+    bool done;
+    int err;
+
+    if (zin == NULL) {
+        return (0);
+    }
+    if (zin->threaded) {
+        pthread_mutex_lock(&zin->mutex);
+        zin->stop = true;
+        done = zin->done;
+        pthread_cond_broadcast(&zin->cond);
+        pthread_mutex_unlock(&zin->mutex);
+        if (!done) {
+            // It may be waiting in read(), for input that never comes.
+            pthread_cancel(zin->thread);
+        }
+        pthread_join(zin->thread, NULL);
+    }
+    err = zin->err;
+    if (zin->codec != ZS_NONE) {
+        zin_codec_fini(zin);
+        zblock_ring_free(zin->ringv, zin->depth);
+        free(zin->ibuf);
+        pthread_mutex_destroy(&zin->mutex);
+        pthread_cond_destroy(&zin->cond);
+    }
+    free(zin);
+    return (err);
+}
+
+// ################ output
+
+/*
+ * Blocks go round the ring in order.  The caller fills ringv[head],
+ * the workers take filled blocks in order, at |claim|, and compress
+ * them in parallel, and whichever worker finds ringv[wr] done writes
+ * it, and any that are done after it, one worker at a time.
+ */
+struct zout {
+    int        fd;
+    zs_codec_t codec;
+    int        level;
+    size_t     bsize;
+    size_t     osize;
+    size_t     depth;
+    struct zblock *ringv;
+    struct zblock *cur;     // Block the caller is filling, or NULL
+    unsigned int nthreads;
+    pthread_t  *threadv;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    size_t     head;        // Blocks handed to the workers
+    size_t     claim;       // Blocks taken by a worker
+    size_t     wr;          // Blocks written out
+    bool       writing;
+    bool       closing;
+    int        err;
+};
+
+/*
+ * The state of the compressor, one per worker.
+ */
+struct zctx {
+    z_stream   z;
+#ifdef HAVE_ZSTD
+    ZSTD_CCtx  *cctx;
+#endif
+};
+
+static int
+write_all(int fd, const char *buf, size_t n)
+{
+    ssize_t rv;
+
+    while (n != 0) {
+        rv = write(fd, buf, n);
+        if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (errno);
+        }
+        buf += rv;
+        n -= rv;
+    }
+    return (0);
+}
+
+static int
+zctx_init(zout_t *zout, struct zctx *ctx)
+{
+    int level;
+
+    if (zout->codec == ZS_GZIP) {
+        level = zout->level < 0 ? Z_DEFAULT_COMPRESSION : zout->level;
+        // 15 + 16: the largest window, and a gzip header
+        if (deflateInit2(&ctx->z, level, Z_DEFLATED, 15 + 16, 8,
+            Z_DEFAULT_STRATEGY) != Z_OK) {
+            return (ENOMEM);
+        }
+        return (0);
+    }
+#ifdef HAVE_ZSTD
+    ctx->cctx = ZSTD_createCCtx();
+    if (ctx->cctx == NULL) {
+        return (ENOMEM);
+    }
+#endif
+    return (0);
+}
+
+static void
+zctx_fini(zout_t *zout, struct zctx *ctx)
+{
+    if (zout->codec == ZS_GZIP) {
+        deflateEnd(&ctx->z);
+    }
+#ifdef HAVE_ZSTD
+    if (ctx->cctx != NULL) {
+        ZSTD_freeCCtx(ctx->cctx);
+    }
+#endif
+}
+
+/*
+ * Compress one block, as a whole gzip member or zstd frame.
+ * |osize| is big enough for any input, so this cannot run out
+ * of room.
+ */
+static int
+zctx_compress(zout_t *zout, struct zctx *ctx, struct zblock *blk)
+{
+#ifdef HAVE_ZSTD
+    size_t ret;
+
+    if (zout->codec == ZS_ZSTD) {
+        ret = ZSTD_compressCCtx(ctx->cctx, blk->obuf, zout->osize,
+            blk->buf, blk->len, zout->level < 0 ? 3 : zout->level);
+        if (ZSTD_isError(ret)) {
+            return (EIO);
+        }
+        blk->olen = ret;
+        return (0);
+    }
+#endif
+    deflateReset(&ctx->z);
+    ctx->z.next_in = (unsigned char *)blk->buf;
+    ctx->z.avail_in = blk->len;
+    ctx->z.next_out = (unsigned char *)blk->obuf;
+    ctx->z.avail_out = zout->osize;
+    if (deflate(&ctx->z, Z_FINISH) != Z_STREAM_END) {
+        return (EIO);
+    }
+    blk->olen = zout->osize - ctx->z.avail_out;
+    return (0);
+}
+
+/*
+ * Write out every block that is done, in order, starting at |wr|.
+ * Called, and returns, with the mutex held; it is let go while
+ * writing, so that the other workers and the caller carry on.
+ */
+static void
+zout_drain(zout_t *zout)
+{
+    struct zblock *blk;
+    int err;
+
+    while (!zout->writing) {
+        blk = &zout->ringv[zout->wr % zout->depth];
+        if (blk->state != ZB_DONE) {
+            break;
+        }
+        zout->writing = true;
+        err = zout->err;
+        pthread_mutex_unlock(&zout->mutex);
+        if (err == 0) {
+            err = write_all(zout->fd, blk->obuf, blk->olen);
+        }
+        pthread_mutex_lock(&zout->mutex);
+        if (err && zout->err == 0) {
+            zout->err = err;
+        }
+        // After an error, blocks are still let go, but not written.
+        blk->state = ZB_FREE;
+        ++zout->wr;
+        zout->writing = false;
+        pthread_cond_broadcast(&zout->cond);
+    }
+}
+
+static void *
+zout_thread(void *arg)
+{
+    zout_t *zout = (zout_t *)arg;
+    struct zblock *blk;
+    struct zctx ctx;
+    int err;
+
+    memset(&ctx, 0, sizeof (ctx));
+    err = zctx_init(zout, &ctx);
+    pthread_mutex_lock(&zout->mutex);
+    if (err && zout->err == 0) {
+        zout->err = err;
+    }
+    while (true) {
+        while (zout->claim == zout->head && !zout->closing) {
+            pthread_cond_wait(&zout->cond, &zout->mutex);
+        }
+        if (zout->claim == zout->head) {
+            break;
+        }
+        blk = &zout->ringv[zout->claim % zout->depth];
+        ++zout->claim;
+        blk->state = ZB_BUSY;
+        pthread_mutex_unlock(&zout->mutex);
+
+        blk->olen = 0;
+        if (err == 0) {
+            err = zctx_compress(zout, &ctx, blk);
+        }
+
+        pthread_mutex_lock(&zout->mutex);
+        if (err && zout->err == 0) {
+            zout->err = err;
+        }
+        blk->state = ZB_DONE;
+        zout_drain(zout);
+    }
+    pthread_mutex_unlock(&zout->mutex);
+    zctx_fini(zout, &ctx);
+    return (NULL);
+}
+
+/*
+ * Wait for the next block in the ring to be free, and make it
+ * the one being filled.
+ */
+static int
+zout_get_block(zout_t *zout)
+{
+    struct zblock *blk;
+    int err;
+
+    pthread_mutex_lock(&zout->mutex);
+    blk = &zout->ringv[zout->head % zout->depth];
+    while (blk->state != ZB_FREE && zout->err == 0) {
+        pthread_cond_wait(&zout->cond, &zout->mutex);
+    }
+    err = zout->err;
+    pthread_mutex_unlock(&zout->mutex);
+    if (err) {
+        return (err);
+    }
+    blk->len = 0;
+    zout->cur = blk;
+    return (0);
+}
+
+static void
+zout_submit(zout_t *zout)
+{
+    pthread_mutex_lock(&zout->mutex);
+    zout->cur->state = ZB_FILLED;
+    zout->cur = NULL;
+    ++zout->head;
+    pthread_cond_broadcast(&zout->cond);
+    pthread_mutex_unlock(&zout->mutex);
+}
+
+/**
+ * @brief Start writing a compressed stream to |fd|.
+ *
+ * @param zout_ref  out  Writer; NULL on error.
+ * @param fd        in   File descriptor; it is not closed by zout_close().
+ * @param codec     in   ZS_GZIP or ZS_ZSTD
+ * @param level     in   Compression level; negative for the default.
+ * @param nthreads  in   Compressor threads; 0 means one per CPU,
+ *                       up to 8.
+ * @return 0, or an errno.
+ */
+int
+zout_open(zout_t **zout_ref, int fd, zs_codec_t codec, int level,
+    unsigned int nthreads)
+{
+    zout_t *zout;
+    struct zctx ctx;
+    long ncpu;
+    unsigned int i;
+    int err;
+
+    *zout_ref = NULL;
+    if (codec != ZS_GZIP && codec != ZS_ZSTD) {
+        return (EINVAL);
+    }
+    if (!zs_codec_available(codec)) {
+        return (ENOTSUP);
+    }
+    if (nthreads == 0) {
+        ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu < 1 ? 1 : (unsigned int)ncpu;
+        if (nthreads > ZOUT_THREADS_MAX) {
+            nthreads = ZOUT_THREADS_MAX;
+        }
+    }
+
+    zout = (zout_t *)guard_calloc(1, sizeof (zout_t));
+    zout->fd = fd;
+    zout->codec = codec;
+    zout->level = level;
+    zout->bsize = ZS_BSIZE_DEFAULT;
+
+    // Room for the worst case, so that a block is always done in one go.
+    memset(&ctx, 0, sizeof (ctx));
+    err = zctx_init(zout, &ctx);
+    if (err) {
+        free(zout);
+        return (err);
+    }
+#ifdef HAVE_ZSTD
+    if (codec == ZS_ZSTD) {
+        zout->osize = ZSTD_compressBound(zout->bsize);
+    }
+    else
+#endif
+    zout->osize = deflateBound(&ctx.z, zout->bsize);
+    zctx_fini(zout, &ctx);
+
+    // Enough blocks that every worker can have one, while
+    // the caller fills another, and finished ones wait to be written.
+    zout->depth = 2 * nthreads + 1;
+    zout->ringv = zblock_ring_new(zout->depth, zout->bsize, zout->osize);
+    pthread_mutex_init(&zout->mutex, NULL);
+    pthread_cond_init(&zout->cond, NULL);
+    zout->threadv = (pthread_t *)guard_calloc(nthreads, sizeof (pthread_t));
+    for (i = 0; i < nthreads; ++i) {
+        err = pthread_create(&zout->threadv[i], NULL, zout_thread, zout);
+        if (err) {
+            break;
+        }
+    }
+    zout->nthreads = i;
+    if (i == 0) {
+        zout_close(zout);
+        return (err);
+    }
+    *zout_ref = zout;
+    return (0);
+}
+
+/**
+ * @brief Copy |n| bytes into the stream.
+ *
+ * @return 0, or the first error from compressing or writing.
+ */
+int
+zout_write(zout_t *zout, const void *buf, size_t n)
+{
+    const char *p = (const char *)buf;
+    size_t len;
+    int err;
+
+    while (n != 0) {
+        if (zout->cur == NULL) {
+            err = zout_get_block(zout);
+            if (err) {
+                return (err);
+            }
+        }
+        len = min_size(n, zout->bsize - zout->cur->len);
+        memcpy(zout->cur->buf + zout->cur->len, p, len);
+        zout->cur->len += len;
+        p += len;
+        n -= len;
+        if (zout->cur->len == zout->bsize) {
+            zout_submit(zout);
+        }
+    }
+    return (0);
+}
+
+static ssize_t
+zout_cookie_write(void *cookie, const char *buf, size_t n)
+{
+    int err;
+
+    err = zout_write((zout_t *)cookie, buf, n);
+    if (err) {
+        errno = err;
+        return (0);
+    }
+    return (n);
+}
+
+/**
+ * @brief Make a stdio stream that writes into |zout|.
+ *
+ * fclose() it before zout_close(); fclose() does not close |zout|.
+ */
+FILE *
+zout_fopen(zout_t *zout)
+{
+    cookie_io_functions_t io = { NULL, zout_cookie_write, NULL, NULL };
+
+    return (fopencookie(zout, "w", io));
+}
+
+/**
+ * @brief Compress and write whatever is left, wait for the workers,
+ * and free |zout|.
+ *
+ * An empty stream is still written as one empty member or frame,
+ * so that the output is a valid compressed file.
+ *
+ * @return 0, or the first error from compressing or writing.
+ */
+int
+zout_close(zout_t *zout)
+{
+    unsigned int i;
+    int err;
+
+    if (zout == NULL) {
+        return (0);
+    }
+    if (zout->nthreads != 0) {
+        if (zout->cur == NULL && zout->head == 0) {
+            zout_get_block(zout);
+        }
+        if (zout->cur != NULL) {
+            zout_submit(zout);
+        }
+    }
+    pthread_mutex_lock(&zout->mutex);
+    zout->closing = true;
+    pthread_cond_broadcast(&zout->cond);
+    pthread_mutex_unlock(&zout->mutex);
+    for (i = 0; i < zout->nthreads; ++i) {
+        pthread_join(zout->threadv[i], NULL);
+    }
+    err = zout->err;
+    zblock_ring_free(zout->ringv, zout->depth);
+    free(zout->threadv);
+    pthread_mutex_destroy(&zout->mutex);
+    pthread_cond_destroy(&zout->cond);
+    free(zout);
+    return (err);
+}
@@ -0,0 +1,395 @@
+/*
+ * Filename: fst-cursor.c
+ * Brief: Iterate over the keys of an FST, in order
+ *
+ * Copyright (C) 2015-2016 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+    // Import var ENOENT
+#include <stdbool.h>
+    // Import type bool
+    // Import constant false
+    // Import constant true
+#include <stddef.h>
+    // Import constant NULL
+#include <stdio.h>
+    // Import type FILE
+    // Import fprintf()
+    // Import fputc()
+    // Import fwrite()
+#include <stdlib.h>
+    // Import free()
+#include <string.h>
+    // Import memset()
+#include <unistd.h>
+    // Import type size_t
+
+#define LIBFST_IMPL
+#include <libfst.h>
+#include <libfst-impl.h>
+
+/*
+ * Cursor
+ * ------
+ * Keys are visited in pre-order: a key comes before all the longer
+ * keys that it is a prefix of, and the children of each state are
+ * visited in increasing order of their byte value.
+ *
+ * Transitions are not sorted, so finding the next child of a state
+ * is a scan of its transitions.  That costs O(ntrans) per step,
+ * but it works the same for packed and unpacked FSTs,
+ * and it needs no memory beyond what fst_cursor_new() allocates.
+ *
+ * Range scan
+ * ----------
+ * To visit all keys in [lo, hi):
+ *
+ *     for (rc = fst_cursor_seek(cur, lo);
+ *          rc == 0 && strcmp(fst_cursor_key(cur), hi) < 0;
+ *          rc = fst_cursor_next(cur)) {
+ *         ...
+ *     }
+ */
+
+/*
+ * Find the transition out of |state| with the smallest byte value
+ * that is strictly greater than |after|.  Use after = -1 to get the
+ * smallest child.  Return the index of the transition, or -1.
+ */
+static ssize_t
+next_child(fst_t *fst, state_t state, int after)
+{
+    fst_state_t *sv;
+    ssize_t best;
+    int best_chr;
+    size_t i;
+
+    sv = (fst_state_t *)fst->states.base + state;
+    best = -1;
+    best_chr = 256;
+    for (i = 0; i < sv->ntrans; ++i) {
+        int chr = sv->transv[i].t_chr & 0xFF;
+        if (chr > after && chr < best_chr) {
+            best = (ssize_t)i;
+            best_chr = chr;
+        }
+    }
+    return (best);
+}
+
+static inline state_t
+cursor_top(fst_cursor_t *cur)
+{
+    return (cur->stackv[cur->depth]);
+}
+
+static inline void
+cursor_push(fst_cursor_t *cur, trans_t *tp)
+{
+    cur->key[cur->depth] = (char)tp->t_chr;
+    ++cur->depth;
+    cur->stackv[cur->depth] = as_state(tp->t_next);
+    cur->key[cur->depth] = '\0';
+}
+
+static inline bool
+cursor_at_final(fst_cursor_t *cur)
+{
+    return (is_final_state(cur->fst, cursor_top(cur)));
+}
+
+/*
+ * Starting at the current state, go down the leftmost path
+ * until we come to a final state.
+ */
+static int
+cursor_leftmost(fst_cursor_t *cur)
+{
+    fst_state_t *s0;
+    ssize_t t;
+
+    s0 = (fst_state_t *)cur->fst->states.base;
+    while (!cursor_at_final(cur)) {
+        state_t state = cursor_top(cur);
+        t = next_child(cur->fst, state, -1);
+        if (t < 0) {
+            cur->valid = false;
+            return (ENOENT);
+        }
+        cursor_push(cur, &s0[state].transv[t]);
+    }
+    cur->valid = true;
+    return (0);
+}
+
+/*
+ * The subtree below the current state is exhausted.
+ * Climb until some ancestor has a next sibling, then go down
+ * to the first key in that sibling's subtree.
+ */
+static int
+cursor_climb(fst_cursor_t *cur)
+{
+    fst_state_t *s0;
+    ssize_t t;
+
+    s0 = (fst_state_t *)cur->fst->states.base;
+    while (cur->depth > cur->plen) {
+        int chr = cur->key[cur->depth - 1] & 0xFF;
+        --cur->depth;
+        cur->key[cur->depth] = '\0';
+        t = next_child(cur->fst, cursor_top(cur), chr);
+        if (t >= 0) {
+            cursor_push(cur, &s0[cursor_top(cur)].transv[t]);
+            return (cursor_leftmost(cur));
+        }
+    }
+    cur->valid = false;
+    return (ENOENT);
+}
+
+/*
+ * The length of the longest key in the FST.
+ *
+ * Transitions always go from a lower-numbered state to
+ * a higher-numbered state (fst_add_transition() refuses anything else),
+ * so visiting states from highest to lowest gives the height
+ * of every child before its parent.
+ */
+static size_t
+fst_max_depth(fst_t *fst)
+{
+    fst_state_t *s0;
+    size_t *height;
+    size_t nstates;
+    size_t max;
+    state_t state;
+    size_t i;
+
+    s0 = (fst_state_t *)fst->states.base;
+    nstates = fst->states.len + 1;
+    height = (size_t *)guard_malloc(nstates * sizeof (size_t));
+    state = nstates;
+    while (state-- > 0) {
+        fst_state_t *sv = s0 + state;
+        height[state] = 0;
+        for (i = 0; i < sv->ntrans; ++i) {
+            size_t h = height[as_state(sv->transv[i].t_next)] + 1;
+            if (h > height[state]) {
+                height[state] = h;
+            }
+        }
+    }
+    max = height[0];
+    free(height);
+    return (max);
+}
+
+fst_cursor_t *
+fst_cursor_new(fst_t *fst)
+{
+    fst_cursor_t *cur;
+
+    if (fst == NULL || fst->states.base == NULL) {
+        fprintf(stderr, "fst_cursor_new: no fst\n");
+        exit(32);
+    }
+
+    cur = (fst_cursor_t *)guard_malloc(sizeof (fst_cursor_t));
+    memset(cur, 0, sizeof (fst_cursor_t));
+    cur->fst = fst;
+    cur->maxdepth = fst_max_depth(fst);
+    cur->stackv = (state_t *)guard_malloc((cur->maxdepth + 1) * sizeof (state_t));
+    cur->key = (char *)guard_malloc(cur->maxdepth + 1);
+    cur->stackv[0] = 0;
+    cur->key[0] = '\0';
+    return (cur);
+}
+
+void
+fst_cursor_free(fst_cursor_t *cur)
+{
+    if (cur == NULL) {
+        return;
+    }
+    free(cur->stackv);
+    free(cur->key);
+    free(cur);
+}
+
+static void
+cursor_reset(fst_cursor_t *cur)
+{
+    cur->depth = 0;
+    cur->plen = 0;
+    cur->stackv[0] = 0;
+    cur->key[0] = '\0';
+    cur->valid = false;
+}
+
+/*
+ * Position the cursor at the smallest key in the FST.
+ * Return 0, or ENOENT if the FST is empty.
+ */
+int
+fst_cursor_first(fst_cursor_t *cur)
+{
+    cursor_reset(cur);
+    return (cursor_leftmost(cur));
+}
+
+/*
+ * Position the cursor at the smallest key that is >= |lbound|.
+ * Return 0, or ENOENT if there is no such key.
+ */
+int
+fst_cursor_seek(fst_cursor_t *cur, const char *lbound)
+{
+    fst_state_t *s0;
+    const char *s;
+    ssize_t t;
+
+    cursor_reset(cur);
+    s0 = (fst_state_t *)cur->fst->states.base;
+    s = lbound;
+    while (*s != '\0') {
+        state_t state = cursor_top(cur);
+        enext_t enext = fst_rule_lookup(cur->fst, state, *s);
+
+        if (enext.err == 0) {
+            cur->key[cur->depth] = *s;
+            ++cur->depth;
+            cur->stackv[cur->depth] = as_state(enext.nxt);
+            cur->key[cur->depth] = '\0';
+            ++s;
+            continue;
+        }
+
+        // |lbound| leaves the FST here.  Every key in the subtree
+        // of the next larger child is greater than |lbound|.
+        t = next_child(cur->fst, state, *s & 0xFF);
+        if (t >= 0) {
+            cursor_push(cur, &s0[state].transv[t]);
+            return (cursor_leftmost(cur));
+        }
+        return (cursor_climb(cur));
+    }
+
+    // All of |lbound| is a path in the FST.
+    // Either it is a key, or the first key below it is the answer.
+    return (cursor_leftmost(cur));
+}
+
+/*
+ * Restrict iteration to keys that start with |prefix|,
+ * and position the cursor at the first such key.
+ * Return 0, or ENOENT if no key starts with |prefix|.
+ */
+int
+fst_cursor_prefix(fst_cursor_t *cur, const char *prefix)
+{
+    const char *s;
+
+    cursor_reset(cur);
+    for (s = prefix; *s != '\0'; ++s) {
+        enext_t enext = fst_rule_lookup(cur->fst, cursor_top(cur), *s);
+        if (enext.err != 0) {
+            return (ENOENT);
+        }
+        cur->key[cur->depth] = *s;
+        ++cur->depth;
+        cur->stackv[cur->depth] = as_state(enext.nxt);
+    }
+    cur->key[cur->depth] = '\0';
+    cur->plen = cur->depth;
+    return (cursor_leftmost(cur));
+}
+
+/*
+ * Advance to the next key.
+ * Return 0, or ENOENT if there are no more keys (within the prefix,
+ * if iteration was restricted by fst_cursor_prefix()).
+ */
+int
+fst_cursor_next(fst_cursor_t *cur)
+{
+    fst_state_t *s0;
+    state_t state;
+    ssize_t t;
+
+    if (!cur->valid) {
+        return (ENOENT);
+    }
+
+    // Keys that the current key is a prefix of come next.
+    s0 = (fst_state_t *)cur->fst->states.base;
+    state = cursor_top(cur);
+    t = next_child(cur->fst, state, -1);
+    if (t >= 0) {
+        cursor_push(cur, &s0[state].transv[t]);
+        return (cursor_leftmost(cur));
+    }
+    return (cursor_climb(cur));
+}
+
+bool
+fst_cursor_valid(fst_cursor_t *cur)
+{
+    return (cur->valid);
+}
+
+const char *
+fst_cursor_key(fst_cursor_t *cur)
+{
+    return (cur->key);
+}
+
+size_t
+fst_cursor_keylen(fst_cursor_t *cur)
+{
+    return (cur->depth);
+}
+
+val_t
+fst_cursor_value(fst_cursor_t *cur)
+{
+    fst_state_t *s0;
+
+    s0 = (fst_state_t *)cur->fst->states.base;
+    return (s0[cursor_top(cur)].fval);
+}
+
+/*
+ * Write every { key, value } pair in an FST, one per line,
+ * in key order, as "key<TAB>value".
+ * Unlike fdump_fst(), the output does not depend on state numbering,
+ * so two tables can be compared with diff(1).
+ */
+void
+fexport_fst(FILE *f, fst_t *fst)
+{
+    fst_cursor_t *cur;
+    int rc;
+
+    cur = fst_cursor_new(fst);
+    for (rc = fst_cursor_first(cur); rc == 0; rc = fst_cursor_next(cur)) {
+        fwrite(cur->key, 1, cur->depth, f);
+        fprintf(f, "\t%zu\n", fst_cursor_value(cur));
+    }
+    fst_cursor_free(cur);
+}
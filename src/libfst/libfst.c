@@ -30,6 +30,8 @@
     // Import constant true
 #include <stddef.h>
     // Import constant NULL
+#include <stdint.h>
+    // Import type uint64_t
 #include <stdio.h>
     // Import type FILE
     // Import fprintf()
@@ -48,24 +50,23 @@
 /*
  * Do not start off with 0 states.
  * Instead, start with 1 state with no transitions.
- * This is because state 0 is special.
- * Transitions to state 0 are final states.
- *
- * XXX Maybe we should use some other value to denote a final state.
- * XXX For what we are doing now, it does not matter, because
- * XXX our FST does not do loops.
+ * State 0 is the start state.
  */
 
 void
-fst_init(vec_t *vp)
+fst_init(fst_t *fst)
 {
     fst_state_t *s0;
 
-    vec_make_room(vp, 10);
-    vp->len = 0;
-    s0 = (fst_state_t *) vp->base;
+    vec_make_room(&fst->states, 10);
+    fst->states.len = 0;
+    fst->jump = NULL;
+    fst->packed = false;
+    s0 = (fst_state_t *) fst->states.base;
     s0->transv = NULL;
     s0->ntrans = 0;
+    s0->fval = 0;
+    s0->final = false;
 }
 
 vec_t *
@@ -80,13 +81,36 @@ vec_new(size_t esize)
     return (new_vec);
 }
 
-vec_t *
+fst_t *
 fst_new()
 {
-    vec_t *vp;
-    vp = vec_new(sizeof (fst_state_t));
-    fst_init(vp);
-    return (vp);
+    fst_t *fst;
+
+    fst = guard_malloc(sizeof (fst_t));
+    fst->states.base = NULL;
+    fst->states.len  = 0;
+    fst->states.size = 0;
+    fst->states.esize = sizeof (fst_state_t);
+    fst_init(fst);
+    return (fst);
+}
+
+/*
+ * Cheap sanity check, suitable for every call to fst_add_string()
+ * or fst_lookup().  fst_validate() visits every state and every
+ * transition, which made each lookup cost O(number of states).
+ */
+static inline void
+fst_check(fst_t *fst)
+{
+    if (fst == NULL) {
+        fprintf(stderr, "fst==NULL\n");
+        exit(32);
+    }
+    if (fst->states.base == NULL) {
+        fprintf(stderr, "fst->base == NULL\n");
+        exit(32);
+    }
 }
 
 err_t
@@ -102,24 +126,17 @@ fst_validate(fst_t *fst)
         fprintf(stderr, "fst==NULL\n");
         exit(32);
     }
-    if (fst->base == NULL) {
+    if (fst->states.base == NULL) {
         fprintf(stderr, "fst->base == NULL\n");
         exit(32);
     }
-    s0 = (fst_state_t *)fst->base;
-    for (state = 0; state < fst->len; ++state) {
+    s0 = (fst_state_t *)fst->states.base;
+    for (state = 0; state <= fst->states.len; ++state) {
         sv = s0 + state;
         ntrans = sv->ntrans;
         for (trnr = 0; trnr < ntrans; ++trnr) {
-            int chr;
-            chr = sv->transv[trnr].t_chr & 0xFF;
-            if (chr == '\0') {
-                // Validate final tansition
-            }
-            else {
-                // Validate next-character transition
-                // Verify that next state is in 0 .. nstates
-            }
+            // Validate next-character transition
+            // Verify that next state is in 0 .. nstates
         }
     }
 
@@ -127,20 +144,11 @@ fst_validate(fst_t *fst)
 }
 
 /*
- * Measure the size in bytes of a given FST data structure.
- * This is useful for converting an FST to a single-allocation data structure.
- *
- * An FST that was built incrementally, using fst_add_string()
- * and related functions, consists of many small objects that were
- * each allocated separately.
- *
- * fst_measure() tells how big of a single memory allocation
- * will hold the entire FST, including any padding or overhead.
- *
+ * Size of the header, state array and transition arrays
+ * of the packed copy of an FST, not counting any jump table.
  */
-
-size_t
-fst_measure(fst_t *fst)
+static size_t
+fst_measure_states(fst_t *fst)
 {
     fst_state_t *s0;
     fst_state_t *sv;
@@ -152,14 +160,16 @@ fst_measure(fst_t *fst)
         fprintf(stderr, "fst==NULL\n");
         exit(32);
     }
-    if (fst->base == NULL) {
+    if (fst->states.base == NULL) {
         fprintf(stderr, "fst->base == NULL\n");
         exit(32);
     }
 
-    total_fst_size = 0;
-    s0 = (fst_state_t *)fst->base;
-    for (state = 0; state < fst->len; ++state) {
+    // State numbers run from 0 through fst->states.len, inclusive.
+    // The packed copy also begins with its own fst_t header.
+    total_fst_size = sizeof (fst_t);
+    s0 = (fst_state_t *)fst->states.base;
+    for (state = 0; state <= fst->states.len; ++state) {
         // XXX debug fprintf(f, "State %zu:\n", state);
         total_fst_size += sizeof (fst_state_t);
         sv = s0 + state;
@@ -169,14 +179,96 @@ fst_measure(fst_t *fst)
     return (total_fst_size);
 }
 
+static inline size_t
+jump_size(fst_jump_t *jp)
+{
+    return (sizeof (fst_jump_t)
+        + jp->depth * sizeof (jp->classv[0])
+        + jp->nentries * sizeof (state_t));
+}
+
 /*
- * dst_fst is a region of memory that has been allocated to hold
- * a copy of src_fst.
- * The contents of dst_fst is unknown.  It gets written over.
+ * Measure the size in bytes of a given FST data structure.
+ * This is useful for converting an FST to a single-allocation data structure.
+ *
+ * An FST that was built incrementally, using fst_add_string()
+ * and related functions, consists of many small objects that were
+ * each allocated separately.
+ *
+ * fst_measure() tells how big of a single memory allocation
+ * will hold the entire FST, including any padding or overhead.
+ *
+ */
+
+size_t
+fst_measure(fst_t *fst)
+{
+    size_t total_fst_size;
+
+    total_fst_size = fst_measure_states(fst);
+    if (fst->jump != NULL) {
+        total_fst_size += jump_size(fst->jump);
+    }
+    return (total_fst_size);
+}
+
+/*
+ * How many bytes of heap an FST occupies, not counting
+ * the allocator's own overhead.
+ *
+ * For a packed FST, that is the same as fst_measure().
+ * For an FST under construction, it includes the spare capacity
+ * of the state array, which fst_measure() does not.
+ */
+
+size_t
+fst_mem_bytes(fst_t *fst)
+{
+    fst_state_t *s0;
+    size_t total;
+    state_t state;
+
+    if (fst->packed) {
+        return (fst_measure(fst));
+    }
+    total = sizeof (fst_t) + fst->states.size * fst->states.esize;
+    s0 = (fst_state_t *)fst->states.base;
+    for (state = 0; state <= fst->states.len; ++state) {
+        total += s0[state].ntrans * sizeof (trans_t);
+    }
+    return (total);
+}
+
+/*
+ * Free an FST made by fst_new() or by fst_copy_and_pack().
  */
 
 void
-fst_pack(fst_t *dst_fst, fst_t *src_fst) {
+fst_free(fst_t *fst)
+{
+    fst_state_t *s0;
+    state_t state;
+
+    if (fst == NULL) {
+        return;
+    }
+    if (!fst->packed) {
+        s0 = (fst_state_t *)fst->states.base;
+        for (state = 0; state <= fst->states.len; ++state) {
+            free(s0[state].transv);
+        }
+        free(fst->states.base);
+    }
+    free(fst);
+}
+
+/*
+ * Copy the header, states and transitions of src_fst into dst_fst.
+ * Return the address just past the last transition array.
+ */
+
+static char *
+fst_pack_states(fst_t *dst_fst, fst_t *src_fst) {
     char *dst_ptr;
     vec_t *vp;
     fst_state_t *s0;
@@ -190,7 +282,7 @@ fst_pack(fst_t *dst_fst, fst_t *src_fst) {
         fprintf(stderr, "src_fst==NULL\n");
         exit(32);
     }
-    if (src_fst->base == NULL) {
+    if (src_fst->states.base == NULL) {
         fprintf(stderr, "src_fst->base == NULL\n");
         exit(32);
     }
@@ -200,13 +292,16 @@ fst_pack(fst_t *dst_fst, fst_t *src_fst) {
     }
 
     dst_ptr = (char *)dst_fst;
-    vp = (vec_t *)dst_ptr;
-    s0 = (fst_state_t *)src_fst->base;
+    vp = &dst_fst->states;
+    s0 = (fst_state_t *)src_fst->states.base;
     memcpy((void *)dst_ptr, src_fst, sizeof (fst_t));
     dst_ptr += sizeof (fst_t);
     vp->base = (void *)dst_ptr;
     // After packing, capacity is the same as current size
-    vp->size = vp->len;
+    // (states 0 .. len, inclusive).
+    vp->size = vp->len + 1;
+    dst_fst->jump = NULL;
+    dst_fst->packed = true;
     
     // Copy state headers.
     // Fill in new .transv pointers
@@ -217,7 +312,7 @@ fst_pack(fst_t *dst_fst, fst_t *src_fst) {
     fst_state_t *dst_s0;
     fst_state_t *dst_sv;
     dst_s0 = (fst_state_t *)dst_ptr;
-    nstates = src_fst->len;
+    nstates = src_fst->states.len + 1;
     tsize = nstates * sizeof (fst_state_t);
     memcpy((void *)dst_ptr, (void *)s0, tsize);
     dst_ptr += tsize;
@@ -235,21 +330,272 @@ fst_pack(fst_t *dst_fst, fst_t *src_fst) {
         memcpy((void *)dst_ptr, (void *)sv->transv, tsize);
         dst_ptr += tsize;
     }
+
+    return (dst_ptr);
 }
 
+/*
+ * Decide the shape of a jump table for |fst|:
+ * how many leading steps it replaces, and the byte classes
+ * at each of those depths.
+ *
+ * The depth is as large as possible, such that
+ *   1) the number of table entries is at most |max_entries|, and
+ *   2) no state at a smaller depth is final.
+ *
+ * Return NULL if a table would replace fewer than 2 steps,
+ * which is not worth the trouble.  Otherwise, return a jump table
+ * descriptor with .classv allocated, but no .statev.
+ */
+
+static fst_jump_t *
+fst_jump_plan(fst_t *fst, size_t max_entries)
+{
+    uint8_t classv[FST_JUMP_MAX_DEPTH][256];
+    size_t nclassv[FST_JUMP_MAX_DEPTH];
+    fst_state_t *s0;
+    fst_jump_t *jp;
+    state_t *frontier;
+    state_t *children;
+    size_t nfront;
+    size_t nchild;
+    size_t depth;
+    size_t nentries;
+    size_t f;
+    size_t i;
+
+    s0 = (fst_state_t *)fst->states.base;
+    frontier = (state_t *)guard_malloc(sizeof (state_t));
+    frontier[0] = 0;
+    nfront = 1;
+    depth = 0;
+    nentries = 1;
+
+    while (depth < FST_JUMP_MAX_DEPTH) {
+        uint8_t *cls = classv[depth];
+        size_t nclass = 0;
+        bool any_final = false;
+
+        memset(cls, 0, sizeof (classv[0]));
+        nchild = 0;
+        for (f = 0; f < nfront; ++f) {
+            fst_state_t *sv = s0 + frontier[f];
+            if (sv->final) {
+                any_final = true;
+                break;
+            }
+            for (i = 0; i < sv->ntrans; ++i) {
+                int chr = sv->transv[i].t_chr & 0xFF;
+                if (cls[chr] == 0) {
+                    ++nclass;
+                    cls[chr] = (uint8_t)nclass;
+                }
+            }
+            nchild += sv->ntrans;
+        }
+        if (any_final || nclass == 0 || nentries * nclass > max_entries) {
+            break;
+        }
+        nentries *= nclass;
+        nclassv[depth] = nclass;
+        ++depth;
+
+        children = (state_t *)guard_malloc(nchild * sizeof (state_t));
+        nchild = 0;
+        for (f = 0; f < nfront; ++f) {
+            fst_state_t *sv = s0 + frontier[f];
+            for (i = 0; i < sv->ntrans; ++i) {
+                children[nchild++] = as_state(sv->transv[i].t_next);
+            }
+        }
+        free(frontier);
+        frontier = children;
+        nfront = nchild;
+    }
+    free(frontier);
+
+    if (depth < 2) {
+        return (NULL);
+    }
+
+    jp = (fst_jump_t *)guard_malloc(sizeof (fst_jump_t));
+    memset(jp, 0, sizeof (fst_jump_t));
+    jp->depth = depth;
+    jp->nentries = nentries;
+    jp->classv = guard_malloc(depth * sizeof (classv[0]));
+    memcpy(jp->classv, classv, depth * sizeof (classv[0]));
+    jp->stridev[depth - 1] = 1;
+    for (i = depth - 1; i > 0; --i) {
+        jp->stridev[i - 1] = jp->stridev[i] * nclassv[i];
+    }
+    jp->statev = NULL;
+    return (jp);
+}
+
+static void
+jump_fill(fst_jump_t *jp, fst_state_t *s0, state_t state, size_t l, size_t idx)
+{
+    fst_state_t *sv;
+    size_t i;
+
+    if (l == jp->depth) {
+        jp->statev[idx] = state;
+        return;
+    }
+    sv = s0 + state;
+    for (i = 0; i < sv->ntrans; ++i) {
+        int chr = sv->transv[i].t_chr & 0xFF;
+        size_t digit = jp->classv[l][chr] - 1;
+        jump_fill(jp, s0, as_state(sv->transv[i].t_next), l + 1,
+            idx + digit * jp->stridev[l]);
+    }
+}
+
+/*
+ * Lay down a jump table, described by |plan|, at |dst_ptr|,
+ * just after the transition arrays of |dst_fst|,
+ * and fill it in from the (already packed) states of |dst_fst|.
+ */
+
+static void
+fst_pack_jump(fst_t *dst_fst, char *dst_ptr, fst_jump_t *plan)
+{
+    fst_jump_t *jp;
+    size_t tsize;
+    size_t i;
+
+    jp = (fst_jump_t *)dst_ptr;
+    *jp = *plan;
+    dst_ptr += sizeof (fst_jump_t);
+
+    tsize = plan->depth * sizeof (plan->classv[0]);
+    memcpy(dst_ptr, plan->classv, tsize);
+    jp->classv = (uint8_t (*)[256])dst_ptr;
+    dst_ptr += tsize;
+
+    jp->statev = (state_t *)dst_ptr;
+    for (i = 0; i < jp->nentries; ++i) {
+        jp->statev[i] = UNDEF_STATE;
+    }
+    jump_fill(jp, (fst_state_t *)dst_fst->states.base, 0, 0, 0);
+    dst_fst->jump = jp;
+}
+
+/*
+ * dst_fst is a region of memory that has been allocated to hold
+ * a copy of src_fst.
+ * The contents of dst_fst is unknown.  It gets written over.
+ *
+ * If src_fst has a jump table, so does the copy.
+ */
+
+void
+fst_pack(fst_t *dst_fst, fst_t *src_fst)
+{
+    char *dst_ptr;
+
+    dst_ptr = fst_pack_states(dst_fst, src_fst);
+    if (src_fst->jump != NULL) {
+        fst_pack_jump(dst_fst, dst_ptr, src_fst->jump);
+    }
+}
+
+/*
+ * Make a packed, single-allocation copy of an FST,
+ * with a jump table of at most |max_entries| entries.
+ * A |max_entries| of 0 means no jump table.
+ *
+ * The jump table costs (256 bytes per step it replaces)
+ * + (sizeof (state_t) * number of entries).
+ */
+
 fst_t *
-fst_copy_and_pack(fst_t *src_fst)
+fst_copy_and_pack_jump(fst_t *src_fst, size_t max_entries)
 {
     fst_t *dst_fst;
-    size_t src_fst_size;
+    fst_jump_t *plan;
+    size_t dst_fst_size;
+    char *dst_ptr;
 
-    src_fst_size = fst_measure(src_fst);
-    dst_fst = (fst_t *)guard_malloc(src_fst_size);
+    plan = NULL;
+    if (max_entries != 0) {
+        plan = fst_jump_plan(src_fst, max_entries);
+    }
+
+    dst_fst_size = fst_measure_states(src_fst);
+    if (plan != NULL) {
+        dst_fst_size += jump_size(plan);
+    }
+    dst_fst = (fst_t *)guard_malloc(dst_fst_size);
     // XXX append guard pattern to end of dst_fst
-    fst_pack(dst_fst, src_fst);
+    dst_ptr = fst_pack_states(dst_fst, src_fst);
+    if (plan != NULL) {
+        fst_pack_jump(dst_fst, dst_ptr, plan);
+        free(plan->classv);
+        free(plan);
+    }
     return (dst_fst);
 }
 
+fst_t *
+fst_copy_and_pack(fst_t *src_fst)
+{
+    return (fst_copy_and_pack_jump(src_fst, FST_JUMP_DEFAULT_ENTRIES));
+}
+
+/*
+ * How many leading steps of a walk are done by the jump table.
+ * 0 means there is no jump table.
+ */
+
+size_t
+fst_jump_depth(fst_t *fst)
+{
+    return (fst->jump == NULL ? 0 : fst->jump->depth);
+}
+
+/*
+ * If the FST has a jump table, take the first |depth| steps
+ * of a walk with a single table lookup, and advance *sp past
+ * the bytes consumed.
+ *
+ * Return 0, with the state reached stored in *statep,
+ * or ENOENT if no key can match.
+ */
+
+static inline int
+fst_jump_start(fst_t *fst, const char **sp, state_t *statep)
+{
+    fst_jump_t *jp;
+    const unsigned char *s;
+    size_t idx;
+    size_t l;
+
+    *statep = 0;
+    jp = fst->jump;
+    if (jp == NULL) {
+        return (0);
+    }
+
+    // A NUL byte has class 0 at every depth,
+    // so we never look past the end of the string.
+    s = (const unsigned char *)*sp;
+    idx = 0;
+    for (l = 0; l < jp->depth; ++l) {
+        unsigned int cls = jp->classv[l][s[l]];
+        if (cls == 0) {
+            return (ENOENT);
+        }
+        idx += (cls - 1) * jp->stridev[l];
+    }
+    if (jp->statev[idx] == UNDEF_STATE) {
+        return (ENOENT);
+    }
+    *statep = jp->statev[idx];
+    *sp += jp->depth;
+    return (0);
+}
+
 void
 fdump_fst(FILE *f, fst_t *fst)
 {
@@ -263,26 +609,27 @@ fdump_fst(FILE *f, fst_t *fst)
         fprintf(stderr, "fst==NULL\n");
         exit(32);
     }
-    if (fst->base == NULL) {
+    if (fst->states.base == NULL) {
         fprintf(stderr, "fst->base == NULL\n");
         exit(32);
     }
-    s0 = (fst_state_t *)fst->base;
-    for (state = 0; state < fst->len; ++state) {
+    s0 = (fst_state_t *)fst->states.base;
+    if (fst->jump != NULL) {
+        fprintf(f, "Jump table: depth=%zu, entries=%zu\n",
+            fst->jump->depth, fst->jump->nentries);
+    }
+    for (state = 0; state <= fst->states.len; ++state) {
         fprintf(f, "State %zu:\n", state);
         sv = s0 + state;
+        if (sv->final) {
+            fprintf(f, "            -> value=%zu\n", sv->fval);
+        }
         ntrans = sv->ntrans;
         for (trnr = 0; trnr < ntrans; ++trnr) {
             int chr;
             chr = sv->transv[trnr].t_chr & 0xFF;
-            if (chr == '\0') {
-                fprintf(f, "            -> value=%zu\n",
-                    as_value(sv->transv[trnr].t_next));
-            }
-            else {
-                fprintf(f, "    %c (%3u) -> %zu\n",
-                    chr, chr, as_state(sv->transv[trnr].t_next));
-            }
+            fprintf(f, "    %c (%3u) -> %zu\n",
+                chr, chr, as_state(sv->transv[trnr].t_next));
         }
     }
 }
@@ -300,15 +647,15 @@ fst_rule_lookup(fst_t *fst, state_t state, int chr)
     enext_t enext;
     size_t i;
 
-    if (state >= fst->len + 1) {
+    if (state >= fst->states.len + 1) {
         fprintf(stderr, "%s: invalid state:\n", __FUNCTION__);
-        fprintf(stderr, "   state=%zu, nstates=%zu\n", state, fst->len);
+        fprintf(stderr, "   state=%zu, nstates=%zu\n", state, fst->states.len);
         enext.err = EDOM;
         enext.nxt = (next_t)UNDEF_STATE;
         return (enext);
     }
 
-    s0 = (fst_state_t *)fst->base;
+    s0 = (fst_state_t *)fst->states.base;
     sv = s0 + state;
 
     // Linear search.
@@ -331,11 +678,8 @@ fst_rule_lookup(fst_t *fst, state_t state, int chr)
  * Add the transition { chr -> next } to the rules at state 'state'.
  * Add a transition to an existing rule.
  *
- * The value, 'next' can be either a next state or a vlue to be returned,
- * in the case of a 'final' state.
- *
- * A trasnition from '\0' is a final state.
- * All other transitions are to a next state.
+ * All transitions are to a next state.
+ * Final states are marked in the state, itself; see fst_add_string().
  *
  * Implementation notes
  * --------------------
@@ -349,13 +693,13 @@ fst_add_transition(fst_t *fst, state_t state, int chr, next_t next)
     fst_state_t *sv;
     size_t ntrans;
 
-    if (state >= fst->len + 1) {
+    if (state >= fst->states.len + 1) {
         fprintf(stderr, "%s: invalid state:\n", __FUNCTION__);
-        fprintf(stderr, "   state=%zu, nstates=%zu\n", state, fst->len);
+        fprintf(stderr, "   state=%zu, nstates=%zu\n", state, fst->states.len);
         return (EDOM);
     }
 
-    if (chr != 0) {
+    {
         state_t new_state;
         new_state = as_state(next);
         if (new_state <= state) {
@@ -365,7 +709,7 @@ fst_add_transition(fst_t *fst, state_t state, int chr, next_t next)
         }
     }
 
-    s0 = (fst_state_t *)fst->base;
+    s0 = (fst_state_t *)fst->states.base;
     sv = s0 + state;
     ntrans = sv->ntrans;
     size_t new_size = (ntrans + 1) * sizeof (trans_t);
@@ -395,13 +739,15 @@ fst_add_state(fst_t *fst)
     fst_state_t *sv;
     state_t new_state;
 
-    new_state = fst->len + 1;
-    vec_make_room(fst, new_state);
-    ++fst->len;
-    s0 = (fst_state_t *)fst->base;
+    new_state = fst->states.len + 1;
+    vec_make_room(&fst->states, new_state);
+    ++fst->states.len;
+    s0 = (fst_state_t *)fst->states.base;
     sv = s0 + new_state;
     sv->transv = NULL;
     sv->ntrans = 0;
+    sv->fval = 0;
+    sv->final = false;
     return (new_state);
 }
 
@@ -427,35 +773,35 @@ fst_add_string(fst_t *fst, const char *str, val_t val)
     state_t new_state;
     int err = 0;
 
-    fst_validate(fst);
+    fst_check(fst);
     s = str;
     state = 0;
     while (true) {
         chr = *s;
-        enext = fst_rule_lookup(fst, state, chr);
-        err = enext.err;
-        if (err != 0 && err != ENOENT) {
-            break;
-        }
-        nxt = enext.nxt;
-        new_state = as_state(nxt);
         if (chr == '\0') {
-            if (err == ENOENT) {
-                // This is a _final_ state.
-                // Store the value (entry number) instead of next state.
-                err = fst_add_transition(fst, state, 0, (next_t)val);
-                if (err) {
-                    fprintf(stderr, "fst_add_transition: err=%d\n", err);
-                }
-            }
-            else {
+            fst_state_t *sv = (fst_state_t *)fst->states.base + state;
+            if (sv->final) {
                 // This entire string is a duplicate.
                 err = EEXIST;
             }
+            else {
+                // This is a _final_ state.
+                // Record the value (entry number) in the state.
+                sv->final = true;
+                sv->fval = val;
+                err = 0;
+            }
             // No more characters in this string.  We are done.
             break;
         }
-        else if (err == ENOENT) {
+        enext = fst_rule_lookup(fst, state, chr);
+        err = enext.err;
+        if (err != 0 && err != ENOENT) {
+            break;
+        }
+        nxt = enext.nxt;
+        new_state = as_state(nxt);
+        if (err == ENOENT) {
             // No match for this character in this state.
             // Add a new state.  Then, add the transition
             // from { current state, chr } -> new state.
@@ -475,57 +821,39 @@ fst_add_string(fst_t *fst, const char *str, val_t val)
 int
 fst_lookup(fst_t *fst, const char *str, val_t *ret_val_ref, bool pfx)
 {
+    fst_state_t *s0;
+    fst_state_t *sv;
     const char *s;
     int chr;
     enext_t enext;
-    next_t nxt;
     state_t state;
-    state_t new_state;
-    int err = 0;
 
-    fst_validate(fst);
+    fst_check(fst);
+    s0 = (fst_state_t *)fst->states.base;
     s = str;
-    state = 0;
+    if (fst_jump_start(fst, &s, &state) != 0) {
+        return (ENOENT);
+    }
     while (true) {
+        sv = s0 + state;
         chr = *s;
-        enext = fst_rule_lookup(fst, state, chr);
-        err = enext.err;
-        if (err != 0 && err != ENOENT) {
-            break;
-        }
-        nxt = enext.nxt;
-        new_state = as_state(nxt);
-        if (chr == '\0') {
-            if (err == ENOENT) {
-                return (err);
-            }
-            else {
-                // This entire string is a match.
-                // Set the value of the final state
-                *ret_val_ref = nxt.val;
-                return (0);
+        if (chr == '\0' || (pfx && sv->final)) {
+            if (!sv->final) {
+                return (ENOENT);
             }
-            // No more characters in this string.  We are done.
-            return (ENOENT);
-        }
-        else if (pfx && is_final_state(fst, state)) {
-            fst_state_t *s0 = (fst_state_t *)fst->base;
-            fst_state_t *sv = s0 + state;
-            *ret_val_ref = as_value(sv->transv[0].t_next);
-            return (0);
-        }
-        else if (err == ENOENT) {
-            return (ENOENT);
-        }
-        else if (nxt.next_state == 0) {
-            *ret_val_ref = nxt.val;
+            // Either this entire string is a match,
+            // or we have come to a final state in a prefix lookup.
+            *ret_val_ref = sv->fval;
             return (0);
         }
 
-        state = new_state;
+        enext = fst_rule_lookup(fst, state, chr);
+        if (enext.err != 0) {
+            return (enext.err);
+        }
+        state = as_state(enext.nxt);
         ++s;
     }
-    return (err);
 }
 
 /*
@@ -553,3 +881,393 @@ fst_lookup_prefix(fst_t *fst, const char *str, val_t *ret_val_ref)
 {
     return (fst_lookup(fst, str, ret_val_ref, true));
 }
+
+/*
+ * Powers of 10 that fit in 64 bits.
+ */
+static const uint64_t pow10_u64[20] = {
+    1ULL,
+    10ULL,
+    100ULL,
+    1000ULL,
+    10000ULL,
+    100000ULL,
+    1000000ULL,
+    10000000ULL,
+    100000000ULL,
+    1000000000ULL,
+    10000000000ULL,
+    100000000000ULL,
+    1000000000000ULL,
+    10000000000000ULL,
+    100000000000000ULL,
+    1000000000000000ULL,
+    10000000000000000ULL,
+    100000000000000000ULL,
+    1000000000000000000ULL,
+    10000000000000000000ULL,
+};
+
+/*
+ * Decimal digit |pos| (0 is the most significant) of |key|,
+ * as if |key| were written with exactly |ndigits| digits,
+ * as an ASCII character.
+ */
+static inline int
+u64_digit(uint64_t key, size_t ndigits, size_t pos)
+{
+    return ('0' + (int)((key / pow10_u64[ndigits - 1 - pos]) % 10));
+}
+
+/*
+ * Lookup a prefix of a numeric key.
+ *
+ * The key is |key|, written in decimal, with leading zeros,
+ * as exactly |ndigits| digits.  The result is the same as
+ * fst_lookup_prefix() on that string, but the digits are extracted
+ * arithmetically, one at a time, as the walk needs them.
+ * No string is ever built.
+ *
+ * Return EDOM if |key| does not fit in |ndigits| digits.
+ */
+
+int
+fst_lookup_prefix_u64(fst_t *fst, uint64_t key, size_t ndigits,
+    val_t *ret_val_ref)
+{
+    fst_state_t *s0;
+    fst_state_t *sv;
+    fst_jump_t *jp;
+    enext_t enext;
+    state_t state;
+    size_t pos;
+
+    fst_check(fst);
+    if (ndigits == 0 || ndigits > 19 || key >= pow10_u64[ndigits]) {
+        return (EDOM);
+    }
+
+    s0 = (fst_state_t *)fst->states.base;
+    state = 0;
+    pos = 0;
+
+    // Same as fst_jump_start(), but with digits of |key|.
+    jp = fst->jump;
+    if (jp != NULL) {
+        size_t idx = 0;
+        size_t l;
+
+        if (ndigits < jp->depth) {
+            return (ENOENT);
+        }
+        for (l = 0; l < jp->depth; ++l) {
+            unsigned int cls = jp->classv[l][u64_digit(key, ndigits, l)];
+            if (cls == 0) {
+                return (ENOENT);
+            }
+            idx += (cls - 1) * jp->stridev[l];
+        }
+        state = jp->statev[idx];
+        if (state == UNDEF_STATE) {
+            return (ENOENT);
+        }
+        pos = jp->depth;
+    }
+
+    while (true) {
+        sv = s0 + state;
+        if (pos == ndigits || sv->final) {
+            if (!sv->final) {
+                return (ENOENT);
+            }
+            *ret_val_ref = sv->fval;
+            return (0);
+        }
+
+        enext = fst_rule_lookup(fst, state, u64_digit(key, ndigits, pos));
+        if (enext.err != 0) {
+            return (enext.err);
+        }
+        state = as_state(enext.nxt);
+        ++pos;
+    }
+}
+
+/*
+ * Enumerate every prefix of |str| that is a key in the FST,
+ * shortest first, in a single walk.
+ *
+ * For each match, call fn(arg, len, val), where |len| is the length
+ * of the matching prefix.  If |fn| returns non-zero, stop the walk,
+ * and return what |fn| returned.
+ *
+ * Return 0 if there was at least one match; otherwise ENOENT.
+ */
+
+int
+fst_lookup_all_prefixes(fst_t *fst, const char *str,
+    fst_match_fn_t fn, void *arg)
+{
+    fst_state_t *s0;
+    fst_state_t *sv;
+    const char *s;
+    enext_t enext;
+    state_t state;
+    int err = ENOENT;
+    int rv;
+
+    fst_check(fst);
+    s0 = (fst_state_t *)fst->states.base;
+    s = str;
+    if (fst_jump_start(fst, &s, &state) != 0) {
+        return (ENOENT);
+    }
+    while (true) {
+        sv = s0 + state;
+        if (sv->final) {
+            err = 0;
+            rv = fn(arg, (size_t)(s - str), sv->fval);
+            if (rv != 0) {
+                return (rv);
+            }
+        }
+        if (*s == '\0') {
+            break;
+        }
+        enext = fst_rule_lookup(fst, state, *s);
+        if (enext.err != 0) {
+            break;
+        }
+        state = as_state(enext.nxt);
+        ++s;
+    }
+    return (err);
+}
+
+/*
+ * Lookup the longest prefix of |str| that is a key in the FST.
+ *
+ * If |ret_len_ref| is not NULL, the length of the matching prefix
+ * is stored there.
+ *
+ * Return 0 if some prefix matched; otherwise ENOENT.
+ */
+
+int
+fst_lookup_longest_prefix(fst_t *fst, const char *str,
+    val_t *ret_val_ref, size_t *ret_len_ref)
+{
+    fst_state_t *s0;
+    fst_state_t *sv;
+    const char *s;
+    enext_t enext;
+    state_t state;
+    int err = ENOENT;
+
+    fst_check(fst);
+    s0 = (fst_state_t *)fst->states.base;
+    s = str;
+    if (fst_jump_start(fst, &s, &state) != 0) {
+        return (ENOENT);
+    }
+    while (true) {
+        sv = s0 + state;
+        if (sv->final) {
+            err = 0;
+            *ret_val_ref = sv->fval;
+            if (ret_len_ref != NULL) {
+                *ret_len_ref = (size_t)(s - str);
+            }
+        }
+        if (*s == '\0') {
+            break;
+        }
+        enext = fst_rule_lookup(fst, state, *s);
+        if (enext.err != 0) {
+            break;
+        }
+        state = as_state(enext.nxt);
+        ++s;
+    }
+    return (err);
+}
+
+/*
+ * Batch prefix lookup
+ * -------------------
+ * Each step of fst_lookup() depends on the result of the load done
+ * by the step before it, so a single walk is one long chain of
+ * cache misses.  Walks of different keys are independent of each other,
+ * so we keep FST_BATCH_WIDTH keys in flight, and advance them
+ * round-robin, one half-step at a time:
+ *
+ *   LANE_HEADER:  The state header has been prefetched.
+ *                 Load the address of its transition array,
+ *                 and prefetch the transition array.
+ *
+ *   LANE_TRANS:   The transition array has been prefetched.
+ *                 Find the transition for the next character,
+ *                 and prefetch the header of the next state.
+ *
+ * By the time we come back around to a given lane, the prefetch
+ * issued for it has had FST_BATCH_WIDTH - 1 other half-steps
+ * to complete.  When a lane finishes, it is immediately refilled
+ * with the next key, so the pipeline stays full until the
+ * input is exhausted.
+ *
+ * The results are exactly those of calling fst_lookup_prefix()
+ * on each key in turn.
+ */
+
+#define FST_BATCH_WIDTH 16
+
+enum lane_phase { LANE_IDLE, LANE_HEADER, LANE_TRANS };
+
+struct lane {
+    const char  *s;
+    fst_state_t *sv;
+    size_t      idx;
+    int         phase;
+};
+
+typedef struct lane lane_t;
+
+#if defined(__GNUC__)
+#define fst_prefetch(addr) __builtin_prefetch((addr), 0, 3)
+#else
+#define fst_prefetch(addr) ((void)(addr))
+#endif
+
+/*
+ * Take one step for one lane, with the transition array already loaded.
+ * Return true if the walk for this lane is finished,
+ * in which case the result has been stored in vals[] and errs[].
+ */
+static inline bool
+lane_step(lane_t *lp, fst_state_t *s0, val_t *vals, int *errs)
+{
+    fst_state_t *sv;
+    trans_t *tv;
+    size_t ntrans;
+    size_t i;
+    int chr;
+
+    sv = lp->sv;
+    tv = sv->transv;
+    ntrans = sv->ntrans;
+    chr = *lp->s;
+
+    if (chr == '\0' || sv->final) {
+        if (!sv->final) {
+            errs[lp->idx] = ENOENT;
+            return (true);
+        }
+        vals[lp->idx] = sv->fval;
+        errs[lp->idx] = 0;
+        return (true);
+    }
+
+    for (i = 0; i < ntrans; ++i) {
+        if (tv[i].t_chr == chr) {
+            lp->sv = s0 + as_state(tv[i].t_next);
+            ++lp->s;
+            fst_prefetch(lp->sv);
+            return (false);
+        }
+    }
+    errs[lp->idx] = ENOENT;
+    return (true);
+}
+
+/*
+ * Start the walk for the next key that is not decided by
+ * the jump table alone.  Keys that the jump table rejects
+ * are finished on the spot.  Return false if there are no more keys.
+ */
+static inline bool
+lane_load(lane_t *lp, fst_t *fst, const char **keys, size_t n,
+    size_t *next_keyp, int *errs)
+{
+    fst_state_t *s0;
+    state_t state;
+
+    s0 = (fst_state_t *)fst->states.base;
+    while (*next_keyp < n) {
+        size_t idx = *next_keyp;
+
+        ++*next_keyp;
+        lp->s = keys[idx];
+        lp->idx = idx;
+        if (fst_jump_start(fst, &lp->s, &state) != 0) {
+            errs[idx] = ENOENT;
+            continue;
+        }
+        lp->sv = s0 + state;
+        lp->phase = LANE_HEADER;
+        fst_prefetch(lp->sv);
+        return (true);
+    }
+    lp->phase = LANE_IDLE;
+    return (false);
+}
+
+/*
+ * Lookup a batch of prefixes, keeping several walks in flight at once.
+ *
+ * @param  fst   in   The FST, ideally packed by fst_copy_and_pack()
+ * @param  keys  in   Array of |n| keys (zstrings)
+ * @param  n     in   Number of keys
+ * @param  vals  out  vals[i] is the value for keys[i], if errs[i] == 0
+ * @param  errs  out  errs[i] is what fst_lookup_prefix() would return
+ *
+ * @return the number of keys that were found.
+ */
+
+size_t
+fst_lookup_prefix_batch(fst_t *fst, const char **keys, size_t n,
+    val_t *vals, int *errs)
+{
+    lane_t lanes[FST_BATCH_WIDTH];
+    fst_state_t *s0;
+    size_t next_key;
+    size_t nactive;
+    size_t nfound;
+    size_t i;
+
+    fst_check(fst);
+    s0 = (fst_state_t *)fst->states.base;
+    next_key = 0;
+    nactive = 0;
+    nfound = 0;
+
+    for (i = 0; i < FST_BATCH_WIDTH; ++i) {
+        if (lane_load(&lanes[i], fst, keys, n, &next_key, errs)) {
+            ++nactive;
+        }
+    }
+
+    while (nactive != 0) {
+        for (i = 0; i < FST_BATCH_WIDTH; ++i) {
+            lane_t *lp = &lanes[i];
+
+            if (lp->phase == LANE_HEADER) {
+                fst_prefetch(lp->sv->transv);
+                lp->phase = LANE_TRANS;
+            }
+            else if (lp->phase == LANE_TRANS) {
+                if (!lane_step(lp, s0, vals, errs)) {
+                    lp->phase = LANE_HEADER;
+                    continue;
+                }
+                if (errs[lp->idx] == 0) {
+                    ++nfound;
+                }
+                if (!lane_load(lp, fst, keys, n, &next_key, errs)) {
+                    --nactive;
+                }
+            }
+        }
+    }
+
+    return (nfound);
+}
@@ -0,0 +1,279 @@
+/*
+ * Filename: src/test-isbn/test-isbn-push.c
+ * Project: isbn-hyphenate
+ * Brief: Test isbn_push_*() -- the same input, cut into chunks every way
+ *
+ * Copyright (C) 2016-2020 Guy Shaw
+ * Written by Guy Shaw <gshaw@acm.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+    // Import type bool
+#include <stdio.h>
+    // Import fprintf()
+    // Import printf()
+    // Import var stderr
+#include <errno.h>
+    // Import var EBADMSG
+    // Import var EINVAL
+    // Import var ENOENT
+    // Import var ERANGE
+#include <stdlib.h>
+    // Import exit()
+#include <string.h>
+    // Import memcmp()
+    // Import memcpy()
+    // Import strcmp()
+    // Import strlen()
+
+#include <cscript.h>
+#include <isbn-info.h>
+#include <isbn-push.h>
+
+const char *program_path;
+const char *program_name;
+
+FILE *eprint_fh = NULL;
+FILE *dprint_fh = NULL;
+
+bool verbose  = false;
+bool debug    = false;
+
+/*
+ * Every kind of record, in one input: good ones, an empty one,
+ * a bad check digit, too short, a non-digit, an unknown prefix,
+ * and an unassigned range.  The last record has no delimiter,
+ * so only isbn_push_finish() can hand it over.
+ */
+
+static const char input[] =
+    "9780306406157\n"
+    "\n"
+    "9780306406158\n"
+    "97801\n"
+    "9790000000001\n"
+    "9786050012347\n"
+    "9780312128470\n"
+    "978030640615X\n"
+    "9788132220794";
+
+struct expect {
+    const char *rec;
+    int rv;
+    const char *hyphenated;
+};
+
+static const struct expect expect[] = {
+    { "9780306406157", 0,       "978-0-306-40615-7" },
+    { "",              EINVAL,  NULL },
+    { "9780306406158", EBADMSG, NULL },
+    { "97801",         EINVAL,  NULL },
+    { "9790000000001", ENOENT,  NULL },
+    { "9786050012347", ERANGE,  NULL },
+    { "9780312128470", 0,       "978-0-312-12847-0" },
+    { "978030640615X", EINVAL,  NULL },
+    { "9788132220794", 0,       "978-81-322-2079-4" },
+};
+
+#define NEXPECT (sizeof (expect) / sizeof (expect[0]))
+
+#define MAX_RESULTS 16
+
+struct result {
+    char rec[32];
+    size_t len;
+    int rv;
+    char hyphenated[18];
+};
+
+struct collect {
+    size_t n;
+    struct result r[MAX_RESULTS];
+};
+
+static void
+collect_fn(void *arg, const char *rec, size_t len, int rv,
+    const isbn_lookup_t *res)
+{
+    struct collect *c = (struct collect *)arg;
+    struct result *r;
+
+    if (c->n >= MAX_RESULTS || len >= sizeof (r->rec)) {
+        fprintf(stderr, "collect_fn: too many, or too long.\n");
+        exit(2);
+    }
+    r = &c->r[c->n++];
+    memcpy(r->rec, rec, len);
+    r->rec[len] = '\0';
+    r->len = len;
+    r->rv = rv;
+    r->hyphenated[0] = '\0';
+    if (rv == 0) {
+        memcpy(r->hyphenated, res->hyphenated, sizeof (r->hyphenated));
+    }
+}
+
+/*
+ * Compare what the callback got against the first |nexpect| entries
+ * of expect[].  Anything else is a failure.
+ */
+static void
+check(const char *what, const isbn_push_t *push, const struct collect *c,
+    size_t nexpect)
+{
+    size_t i;
+
+    if (c->n != nexpect || push->nrecords != nexpect) {
+        fprintf(stderr, "%s: %zu records (nrecords=%zu), expected %zu.\n",
+            what, c->n, (size_t)push->nrecords, nexpect);
+        fprintf(stderr, "isbn_push %s failed.\n", what);
+        exit(1);
+    }
+    for (i = 0; i < nexpect; ++i) {
+        const struct result *r = &c->r[i];
+        const struct expect *e = &expect[i];
+
+        if (r->len != strlen(e->rec) || memcmp(r->rec, e->rec, r->len) != 0) {
+            fprintf(stderr, "%s: record %zu is '%s', expected '%s'.\n",
+                what, i, r->rec, e->rec);
+            fprintf(stderr, "isbn_push %s failed.\n", what);
+            exit(1);
+        }
+        if (r->rv != e->rv) {
+            fprintf(stderr, "%s: record %zu '%s' rv=%d, expected %d.\n",
+                what, i, r->rec, r->rv, e->rv);
+            fprintf(stderr, "isbn_push %s failed.\n", what);
+            exit(1);
+        }
+        if (e->hyphenated && strcmp(r->hyphenated, e->hyphenated) != 0) {
+            fprintf(stderr, "%s: record %zu is '%s', expected '%s'.\n",
+                what, i, r->hyphenated, e->hyphenated);
+            fprintf(stderr, "isbn_push %s failed.\n", what);
+            exit(1);
+        }
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    isbn_info_t *isbn;
+    isbn_push_t *push;
+    struct collect c;
+    size_t len = sizeof (input) - 1;
+    size_t csz;
+    size_t k;
+
+    set_eprint_fh();
+    program_path = *argv;
+    program_name = sname(program_path);
+    if (argc != 2) {
+        fprintf(stderr, "Usage: test-isbn-push <isbn-range.xml>\n");
+        exit(2);
+    }
+    isbn = parse_isbn_range_table(argv[1]);
+    if (isbn == NULL) {
+        fprintf(stderr, "Cannot load '%s'.\n", argv[1]);
+        exit(2);
+    }
+
+    // All in one chunk; the last record comes only from finish.
+    c.n = 0;
+    push = isbn_push_new(isbn, '\n', collect_fn, &c);
+    isbn_push_feed(push, input, len);
+    check("one chunk, before finish", push, &c, NEXPECT - 1);
+    isbn_push_finish(push);
+    check("one chunk", push, &c, NEXPECT);
+    isbn_push_finish(push);
+    check("finish twice", push, &c, NEXPECT);
+    isbn_push_free(push);
+    printf("isbn_push one chunk ok.\n");
+
+    // With a trailing delimiter, finish has nothing left to hand over.
+    c.n = 0;
+    push = isbn_push_new(isbn, '\n', collect_fn, &c);
+    isbn_push_feed(push, input, len);
+    isbn_push_feed(push, "\n", 1);
+    check("trailing delimiter", push, &c, NEXPECT);
+    isbn_push_finish(push);
+    check("trailing delimiter, finish", push, &c, NEXPECT);
+    isbn_push_free(push);
+    printf("isbn_push trailing delimiter ok.\n");
+
+    /*
+     * Two chunks, cut at every offset.  That puts a delimiter
+     * as the last byte of one chunk and as the first byte of the next,
+     * cuts records, including the empty one, at every position,
+     * and, at the ends, feeds a zero-length chunk.
+     */
+    for (k = 0; k <= len; ++k) {
+        c.n = 0;
+        push = isbn_push_new(isbn, '\n', collect_fn, &c);
+        isbn_push_feed(push, input, k);
+        isbn_push_feed(push, input + k, len - k);
+        isbn_push_finish(push);
+        check("two chunks", push, &c, NEXPECT);
+        isbn_push_free(push);
+    }
+    printf("isbn_push two chunks ok.\n");
+
+    // Chunks of every size, from one byte up, with empty feeds between.
+    for (csz = 1; csz <= len; ++csz) {
+        c.n = 0;
+        push = isbn_push_new(isbn, '\n', collect_fn, &c);
+        for (k = 0; k < len; k += csz) {
+            isbn_push_feed(push, input + k, (len - k < csz) ? len - k : csz);
+            isbn_push_feed(push, input + k, 0);
+        }
+        isbn_push_finish(push);
+        check("fixed-size chunks", push, &c, NEXPECT);
+        isbn_push_free(push);
+    }
+    printf("isbn_push fixed-size chunks ok.\n");
+
+    // No input at all, and input that is only zero-length chunks.
+    c.n = 0;
+    push = isbn_push_new(isbn, '\n', collect_fn, &c);
+    isbn_push_finish(push);
+    check("no input", push, &c, 0);
+    isbn_push_feed(push, input, 0);
+    isbn_push_feed(push, input, 0);
+    isbn_push_finish(push);
+    check("zero-length feeds", push, &c, 0);
+    isbn_push_free(push);
+    printf("isbn_push empty input ok.\n");
+
+    // Only delimiters: every record is empty, and gets EINVAL.
+    c.n = 0;
+    push = isbn_push_new(isbn, '\n', collect_fn, &c);
+    isbn_push_feed(push, "\n", 1);
+    isbn_push_feed(push, "\n\n", 2);
+    isbn_push_finish(push);
+    if (c.n != 3 || push->nrecords != 3) {
+        fprintf(stderr, "isbn_push empty records failed.\n");
+        exit(1);
+    }
+    for (k = 0; k < c.n; ++k) {
+        if (c.r[k].len != 0 || c.r[k].rv != EINVAL) {
+            fprintf(stderr, "isbn_push empty records failed.\n");
+            exit(1);
+        }
+    }
+    isbn_push_free(push);
+    printf("isbn_push empty records ok.\n");
+
+    return (0);
+}
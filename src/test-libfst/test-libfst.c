@@ -23,11 +23,52 @@
 #include <stdio.h>
     // Import fprintf()
     // Import var stderr
+#include <errno.h>
+    // Import var ENOENT
 #include <stdlib.h>
     // Import exit()
+#include <string.h>
+    // Import strcmp()
 
 #include <libfst.h>
 
+static int
+count_match(void *arg, size_t len, val_t val)
+{
+    size_t *countp = (size_t *)arg;
+
+    printf("    prefix len=%zu -> %zu\n", len, val);
+    ++*countp;
+    return (0);
+}
+
+/*
+ * Gather every match that fst_lookup_all_prefixes() reports,
+ * so that two FSTs can be compared.
+ */
+
+#define MAX_MATCHES 8
+
+struct matches {
+    size_t n;
+    size_t len[MAX_MATCHES];
+    val_t  val[MAX_MATCHES];
+};
+
+static int
+collect_match(void *arg, size_t len, val_t val)
+{
+    struct matches *mp = (struct matches *)arg;
+
+    if (mp->n >= MAX_MATCHES) {
+        return (1);
+    }
+    mp->len[mp->n] = len;
+    mp->val[mp->n] = val;
+    ++mp->n;
+    return (0);
+}
+
 int
 main()
 {
@@ -83,5 +124,265 @@ main()
         printf("lookup(\"worldly\") -> %zu\n", world_val);
     }
 
+    // "he" is a proper prefix of "hello".
+    rc = fst_add_string(fst, "he", 3);
+    if (rc) {
+        fprintf(stderr, "rc = %d\n", rc);
+        exit(2);
+    }
+
+    {
+        val_t val;
+        size_t len;
+
+        rc = fst_lookup_string(fst, "hello", &val);
+        if (rc || val != 1) {
+            fprintf(stderr, "lookup of \"hello\" failed.\n");
+            exit(1);
+        }
+        rc = fst_lookup_prefix(fst, "hellos", &val);
+        if (rc || val != 3) {
+            fprintf(stderr, "prefix lookup of \"hellos\" failed.\n");
+            exit(1);
+        }
+        rc = fst_lookup_longest_prefix(fst, "hellos", &val, &len);
+        if (rc || val != 1 || len != 5) {
+            fprintf(stderr, "longest prefix lookup of \"hellos\" failed.\n");
+            exit(1);
+        }
+        printf("longest_prefix(\"hellos\") -> %zu, len=%zu\n", val, len);
+        rc = fst_lookup_longest_prefix(fst, "help", &val, &len);
+        if (rc || val != 3 || len != 2) {
+            fprintf(stderr, "longest prefix lookup of \"help\" failed.\n");
+            exit(1);
+        }
+
+        size_t nmatch = 0;
+        rc = fst_lookup_all_prefixes(fst, "hellos", count_match, &nmatch);
+        if (rc || nmatch != 2) {
+            fprintf(stderr, "all prefixes of \"hellos\": %zu.\n", nmatch);
+            exit(1);
+        }
+        printf("all_prefixes(\"hellos\") -> %zu matches\n", nmatch);
+    }
+
+    // Ordered iteration: all keys, keys under a prefix, and from a seek.
+    {
+        static const char *expect_all[] = { "he", "hello", "world" };
+        fst_cursor_t *cur;
+        size_t i;
+
+        cur = fst_cursor_new(fst);
+        i = 0;
+        for (rc = fst_cursor_first(cur); rc == 0; rc = fst_cursor_next(cur)) {
+            if (i >= 3 || strcmp(fst_cursor_key(cur), expect_all[i]) != 0) {
+                fprintf(stderr, "cursor: unexpected key \"%s\".\n",
+                    fst_cursor_key(cur));
+                exit(1);
+            }
+            ++i;
+        }
+        if (i != 3) {
+            fprintf(stderr, "cursor: %zu keys, expected 3.\n", i);
+            exit(1);
+        }
+
+        rc = fst_cursor_prefix(cur, "hel");
+        if (rc || strcmp(fst_cursor_key(cur), "hello") != 0
+            || fst_cursor_next(cur) != ENOENT) {
+            fprintf(stderr, "cursor: prefix \"hel\" failed.\n");
+            exit(1);
+        }
+
+        rc = fst_cursor_seek(cur, "hf");
+        if (rc || strcmp(fst_cursor_key(cur), "world") != 0
+            || fst_cursor_value(cur) != 2) {
+            fprintf(stderr, "cursor: seek \"hf\" failed.\n");
+            exit(1);
+        }
+
+        rc = fst_cursor_seek(cur, "hellp");
+        if (rc || strcmp(fst_cursor_key(cur), "world") != 0) {
+            fprintf(stderr, "cursor: seek \"hellp\" failed.\n");
+            exit(1);
+        }
+
+        rc = fst_cursor_seek(cur, "x");
+        if (rc != ENOENT) {
+            fprintf(stderr, "cursor: seek \"x\" should fail.\n");
+            exit(1);
+        }
+        fst_cursor_free(cur);
+
+        printf("cursor iteration ok; export:\n");
+        fexport_fst(stdout, fst);
+    }
+
+    // Numeric keys: the walk over the digits of a uint64_t
+    // must agree with the walk over the same digits as a string.
+    {
+        fst_t *nfst;
+        val_t val;
+
+        nfst = fst_new();
+        fst_add_string(nfst, "9780", 10);
+        fst_add_string(nfst, "97881", 11);
+        fst_add_string(nfst, "0042", 12);
+        {
+            fst_t *builder = nfst;
+
+            nfst = fst_copy_and_pack(builder);
+            if (fst_mem_bytes(nfst) != fst_measure(nfst)) {
+                fprintf(stderr, "fst_mem_bytes() disagrees.\n");
+                exit(1);
+            }
+            fst_free(builder);
+        }
+        rc = fst_lookup_prefix_u64(nfst, 9788132220794ULL, 13, &val);
+        if (rc || val != 11) {
+            fprintf(stderr, "u64 lookup of 9788132220794 failed.\n");
+            exit(1);
+        }
+        rc = fst_lookup_prefix_u64(nfst, 4200ULL, 6, &val);
+        if (rc || val != 12) {
+            fprintf(stderr, "u64 lookup of 004200 failed.\n");
+            exit(1);
+        }
+        rc = fst_lookup_prefix_u64(nfst, 9789000000000ULL, 13, &val);
+        if (rc != ENOENT) {
+            fprintf(stderr, "u64 lookup of 9789000000000 should fail.\n");
+            exit(1);
+        }
+        printf("u64 lookups ok.\n");
+    }
+
+    // Batch lookup must agree with fst_lookup_prefix() on every key.
+    {
+        static const char *keys[] = {
+            "hello", "world", "worldly", "worl", "help", "", "hello!", "h"
+        };
+        size_t nkeys = sizeof (keys) / sizeof (keys[0]);
+        val_t vals[sizeof (keys) / sizeof (keys[0])];
+        int errs[sizeof (keys) / sizeof (keys[0])];
+        size_t i;
+
+        fst_lookup_prefix_batch(fst, keys, nkeys, vals, errs);
+        for (i = 0; i < nkeys; ++i) {
+            val_t val;
+            int err;
+
+            err = fst_lookup_prefix(fst, keys[i], &val);
+            if (err != errs[i] || (err == 0 && val != vals[i])) {
+                fprintf(stderr, "batch lookup of \"%s\" disagrees.\n",
+                    keys[i]);
+                exit(1);
+            }
+        }
+        printf("batch lookup of %zu keys agrees.\n", nkeys);
+    }
+
+    /*
+     * The jump table is only a shortcut.  Every kind of lookup,
+     * hit or miss, must give the same answer with it as without it,
+     * including keys that end, or go astray, within the first
+     * |depth| bytes that the jump table takes care of.
+     * The jump table stops short of any final state, so every word
+     * here is at least 3 bytes long, to get a table at all.
+     */
+    {
+        static const char *words[] = {
+            "hel", "hello", "world", "978", "9780", "97881", "979", "0042"
+        };
+        static const char *keys[] = {
+            "hello", "hellos", "help", "he", "h", "", "world", "worldly",
+            "worl", "wz", "9780306406157", "9788132220794", "97899",
+            "978", "97", "9", "9799", "0042x", "0041", "00", "hex", "x"
+        };
+        size_t nwords = sizeof (words) / sizeof (words[0]);
+        size_t nkeys = sizeof (keys) / sizeof (keys[0]);
+        val_t pvals[sizeof (keys) / sizeof (keys[0])];
+        val_t jvals[sizeof (keys) / sizeof (keys[0])];
+        int perrs[sizeof (keys) / sizeof (keys[0])];
+        int jerrs[sizeof (keys) / sizeof (keys[0])];
+        fst_t *builder;
+        fst_t *pfst;
+        fst_t *jfst;
+        size_t nfound;
+        size_t i;
+
+        builder = fst_new();
+        for (i = 0; i < nwords; ++i) {
+            fst_add_string(builder, words[i], i + 1);
+        }
+        pfst = fst_copy_and_pack_jump(builder, 0);
+        jfst = fst_copy_and_pack(builder);
+        if (fst_jump_depth(pfst) != 0 || fst_jump_depth(jfst) == 0) {
+            fprintf(stderr, "jump table: depth %zu and %zu.\n",
+                fst_jump_depth(pfst), fst_jump_depth(jfst));
+            exit(1);
+        }
+
+        nfound = fst_lookup_prefix_batch(pfst, keys, nkeys, pvals, perrs);
+        if (fst_lookup_prefix_batch(jfst, keys, nkeys, jvals, jerrs)
+            != nfound) {
+            fprintf(stderr, "jump table: batch found a different number.\n");
+            exit(1);
+        }
+
+        for (i = 0; i < nkeys; ++i) {
+            struct matches pm;
+            struct matches jm;
+            val_t pval, jval;
+            size_t plen, jlen;
+            int prc, jrc;
+            size_t m;
+
+            prc = fst_lookup_prefix(pfst, keys[i], &pval);
+            jrc = fst_lookup_prefix(jfst, keys[i], &jval);
+            if (prc != jrc || (prc == 0 && pval != jval)) {
+                fprintf(stderr, "jump table: prefix lookup of \"%s\" "
+                    "disagrees.\n", keys[i]);
+                exit(1);
+            }
+
+            if (perrs[i] != prc || jerrs[i] != prc
+                || (prc == 0 && (pvals[i] != pval || jvals[i] != pval))) {
+                fprintf(stderr, "jump table: batch lookup of \"%s\" "
+                    "disagrees.\n", keys[i]);
+                exit(1);
+            }
+
+            prc = fst_lookup_longest_prefix(pfst, keys[i], &pval, &plen);
+            jrc = fst_lookup_longest_prefix(jfst, keys[i], &jval, &jlen);
+            if (prc != jrc || (prc == 0 && (pval != jval || plen != jlen))) {
+                fprintf(stderr, "jump table: longest prefix lookup of "
+                    "\"%s\" disagrees.\n", keys[i]);
+                exit(1);
+            }
+
+            pm.n = 0;
+            jm.n = 0;
+            prc = fst_lookup_all_prefixes(pfst, keys[i], collect_match, &pm);
+            jrc = fst_lookup_all_prefixes(jfst, keys[i], collect_match, &jm);
+            if (prc != jrc || pm.n != jm.n) {
+                fprintf(stderr, "jump table: all prefixes of \"%s\" "
+                    "disagree.\n", keys[i]);
+                exit(1);
+            }
+            for (m = 0; m < pm.n; ++m) {
+                if (pm.len[m] != jm.len[m] || pm.val[m] != jm.val[m]) {
+                    fprintf(stderr, "jump table: all prefixes of \"%s\" "
+                        "disagree.\n", keys[i]);
+                    exit(1);
+                }
+            }
+        }
+        printf("jump table (depth %zu) agrees on %zu keys, %zu found.\n",
+            fst_jump_depth(jfst), nkeys, nfound);
+        fst_free(jfst);
+        fst_free(pfst);
+        fst_free(builder);
+    }
+
     exit(0);
 }